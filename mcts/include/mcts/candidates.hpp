@@ -0,0 +1,90 @@
+#ifndef MCTS_CANDIDATES_HPP
+#define MCTS_CANDIDATES_HPP
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace mcts {
+
+    /// States can provide `std::vector<Action> candidate_actions() const`: the actions to try at the node
+    /// (best first), computed once per node when it is widened for the first time. The later widenings
+    /// take the next candidates and then fall back to next_action(). Useful when next_action() runs an
+    /// expensive heuristic that can rank many actions at once.
+    template <typename State>
+    struct has_candidate_actions {
+        template <typename U>
+        static auto test(int) -> decltype(std::declval<const U&>().candidate_actions(), std::true_type());
+
+        template <typename>
+        static std::false_type test(...);
+
+        static constexpr bool value = decltype(test<State>(0))::value;
+    };
+
+    /// candidates of a node that are not tried yet
+    template <typename State, typename Action, bool Enabled = has_candidate_actions<State>::value>
+    class CandidateActions {
+    public:
+        bool ready() const
+        {
+            return true;
+        }
+
+        static std::vector<Action> compute(const State&)
+        {
+            return std::vector<Action>();
+        }
+
+        void fill(std::vector<Action>&&) {}
+
+        bool pop(Action&)
+        {
+            return false;
+        }
+    };
+
+    template <typename State, typename Action>
+    class CandidateActions<State, Action, true> {
+    public:
+        CandidateActions() : _ready(false), _next(0) {}
+
+        bool ready() const
+        {
+            return _ready;
+        }
+
+        static std::vector<Action> compute(const State& state)
+        {
+            return state.candidate_actions();
+        }
+
+        void fill(std::vector<Action>&& candidates)
+        {
+            _candidates = std::move(candidates);
+            _next = 0;
+            _ready = true;
+        }
+
+        bool pop(Action& action)
+        {
+            if (_next >= _candidates.size()) {
+                // release the list once it is used up
+                std::vector<Action>().swap(_candidates);
+                _next = 0;
+                return false;
+            }
+
+            action = _candidates[_next++];
+            return true;
+        }
+
+    protected:
+        std::vector<Action> _candidates;
+        bool _ready;
+        size_t _next;
+    };
+}
+
+#endif
@@ -1,6 +1,15 @@
 #ifndef MCTS_DEFAULTS_HPP
 #define MCTS_DEFAULTS_HPP
 
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <mcts/random.hpp>
+#include <mcts/simd.hpp>
+
 namespace mcts {
 
     template <typename State>
@@ -20,6 +29,16 @@ namespace mcts {
         }
     };
 
+    /// value of the state where a rollout is cut (after rollout_depth steps); the default
+    /// ignores the rest of the return. Estimators take the state (const State& or shared_ptr).
+    struct NoLeafValue {
+        template <typename State>
+        double operator()(const State& state)
+        {
+            return 0.0;
+        }
+    };
+
     struct SimpleSelectPolicy {
         template <typename Node>
         bool operator()(const std::shared_ptr<Node>& node)
@@ -32,17 +51,16 @@ namespace mcts {
         template <typename MCTSAction>
         auto operator()(const std::shared_ptr<MCTSAction>& action) -> std::shared_ptr<typename std::remove_reference<decltype(*(action->parent()))>::type>
         {
-            using NodeType = typename std::remove_reference<decltype(*(action->parent()))>::type;
             auto st = action->parent()->state()->move(action->action());
-            auto to_add = std::make_shared<NodeType>(st, action->parent()->rollout_depth(), action->parent()->gamma());
-            auto it = std::find_if(action->children().begin(), action->children().end(), [&](std::shared_ptr<NodeType> const& p) { return *(p->state()) == *(to_add->state()); });
-            if (action->children().size() == 0 || it == action->children().end()) {
-                to_add->parent() = action;
+            auto child = action->find_child(st);
+            if (!child) {
+                auto to_add = action->parent()->make_node(st);
+                to_add->parent() = action.get();
                 action->children().push_back(to_add);
                 return to_add;
             }
 
-            return (*it);
+            return child;
         }
     };
 
@@ -57,6 +75,13 @@ namespace mcts {
             // return action->value() / (double(action->visits()) + _epsilon) + _c * std::sqrt(2.0 * std::log(action->parent()->visits() + 1.0) / (double(action->visits()) + _epsilon));
             return action->value() / (double(action->visits()) + _epsilon) + 2.0 * Params::uct::c() * std::sqrt(std::log(action->parent()->visits() + 1.0) / (double(action->visits()) + _epsilon));
         }
+
+        /// best child of a node, with all the children scored at once
+        template <typename MCTSNode>
+        size_t argmax(const MCTSNode& node)
+        {
+            return simd::uct_argmax(node.child_values().data(), node.child_visits().data(), node.child_values().size(), std::log(node.visits() + 1.0), 2.0 * Params::uct::c(), _epsilon);
+        }
     };
 
     struct GreedyValue {
@@ -67,6 +92,85 @@ namespace mcts {
         {
             return action->value() / (double(action->visits()) + _epsilon);
         }
+
+        template <typename MCTSNode>
+        size_t argmax(const MCTSNode& node)
+        {
+            return simd::greedy_argmax(node.child_values().data(), node.child_visits().data(), node.child_values().size(), _epsilon);
+        }
+    };
+
+    /// Stopping criteria of MCTSNode::compute(): called with the root of a tree and the number of
+    /// iterations it has done, they return true when the search can stop.
+    struct NeverStop {
+        template <typename Node>
+        bool operator()(const Node& node, size_t iterations)
+        {
+            return false;
+        }
+    };
+
+    /// stop when the most visited action has a share of the visits of the root above
+    /// Params::stop::visit_share() (after Params::stop::min_iterations())
+    template <typename Params>
+    struct VisitShareStop {
+        template <typename Node>
+        bool operator()(const Node& node, size_t iterations)
+        {
+            if (iterations < Params::stop::min_iterations())
+                return false;
+            double best = 0.0, sum = 0.0;
+            for (double n : node.child_visits()) {
+                best = std::max(best, n);
+                sum += n;
+            }
+
+            return sum > 0.0 && best >= Params::stop::visit_share() * sum;
+        }
+    };
+
+    /// stop when the confidence interval of the action with the best mean value is above the intervals
+    /// of all the other actions (after Params::stop::min_iterations()); the half-width of the interval
+    /// of an action visited n times is Params::stop::confidence() / sqrt(n) (in units of the returns)
+    template <typename Params>
+    struct ConfidenceStop {
+        template <typename Node>
+        bool operator()(const Node& node, size_t iterations)
+        {
+            if (iterations < Params::stop::min_iterations())
+                return false;
+            const auto& values = node.child_values();
+            const auto& visits = node.child_visits();
+            // with a single action, the widening may still add the better ones
+            if (visits.size() < 2)
+                return false;
+
+            size_t best = visits.size();
+            double best_mean = -std::numeric_limits<double>::max();
+            for (size_t i = 0; i < visits.size(); i++) {
+                // an action that was never tried could be the best one
+                if (visits[i] == 0.0)
+                    return false;
+                double mean = values[i] / visits[i];
+                if (mean > best_mean) {
+                    best_mean = mean;
+                    best = i;
+                }
+            }
+
+            double lower = best_mean - _width(visits[best]);
+            for (size_t i = 0; i < visits.size(); i++) {
+                if (i != best && values[i] / visits[i] + _width(visits[i]) >= lower)
+                    return false;
+            }
+
+            return true;
+        }
+
+        static double _width(double visits)
+        {
+            return Params::stop::confidence() / std::sqrt(visits);
+        }
     };
 
     template <typename State, typename Action>
@@ -75,6 +179,11 @@ namespace mcts {
         {
             return state->random_action();
         }
+
+        Action operator()(const State& state)
+        {
+            return state.random_action();
+        }
     };
 
     template <typename Params>
@@ -97,19 +206,17 @@ namespace mcts {
         template <typename Action>
         auto operator()(const std::shared_ptr<Action>& action) -> std::shared_ptr<typename std::remove_reference<decltype(*(action->parent()))>::type>
         {
-            using NodeType = typename std::remove_reference<decltype(*(action->parent()))>::type;
-
             if (action->visits() == 0 || std::pow((double)action->visits(), Params::cont_outcome::b()) > action->children().size()) {
                 auto st = action->parent()->state()->move(action->action());
-                auto to_add = std::make_shared<NodeType>(st, action->parent()->rollout_depth(), action->parent()->gamma());
-                auto it = std::find_if(action->children().begin(), action->children().end(), [&](std::shared_ptr<NodeType> const& p) { return *(p->state()) == *(to_add->state()); });
-                if (action->children().size() == 0 || it == action->children().end()) {
-                    to_add->parent() = action;
+                auto child = action->find_child(st);
+                if (!child) {
+                    auto to_add = action->parent()->make_node(st);
+                    to_add->parent() = action.get();
                     action->children().push_back(to_add);
                     return to_add;
                 }
 
-                return (*it);
+                return child;
             }
 
             // Choose child with probability: n(c)/Sum(n(c'))
@@ -117,9 +224,9 @@ namespace mcts {
             for (size_t i = 0; i < action->children().size(); i++) {
                 sum += action->children()[i]->visits();
             }
-            size_t r = static_cast<size_t>(std::rand() * double(sum) / double(RAND_MAX));
+            size_t r = rng::uniform_int<size_t>(0, sum);
             size_t p = 0;
-            for (auto child : action->children()) {
+            for (const auto& child : action->children()) {
                 p += child->visits();
                 if (r <= p)
                     return child;
@@ -130,6 +237,37 @@ namespace mcts {
             return nullptr;
         }
     };
+
+    /// Open-loop search: every action has a single child node, so the statistics are kept per action
+    /// sequence, and the state of that node is re-sampled from the state of its parent at every descent.
+    /// The state of a node is overwritten in place (State has to be copy-assignable): use it with
+    /// iterate()/compute() (serial or parallel roots), not with compute_tree_parallel().
+    struct OpenLoopOutcomeSelect {
+        template <typename Action>
+        auto operator()(const std::shared_ptr<Action>& action) -> std::shared_ptr<typename std::remove_reference<decltype(*(action->parent()))>::type>
+        {
+            auto st = action->parent()->state()->move(action->action());
+            if (action->children().empty()) {
+                auto to_add = action->parent()->make_node(st);
+                to_add->parent() = action.get();
+                action->children().push_back(to_add);
+                return to_add;
+            }
+
+            auto child = action->children()[0];
+            *(child->state()) = st;
+            return child;
+        }
+
+        /// outcome of the action that stands for `state` (used by reroot() and merges): the only one
+        template <typename Action, typename State>
+        auto find(const std::shared_ptr<Action>& action, const State& state) -> std::shared_ptr<typename std::remove_reference<decltype(*(action->parent()))>::type>
+        {
+            if (action->children().empty())
+                return nullptr;
+            return action->children()[0];
+        }
+    };
 }
 
 #endif
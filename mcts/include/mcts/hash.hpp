@@ -0,0 +1,127 @@
+#ifndef MCTS_HASH_HPP
+#define MCTS_HASH_HPP
+
+#include <cstddef>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+namespace mcts {
+
+    /// States and actions can provide `size_t hash() const` to get O(1) child lookups.
+    /// The hash has to agree with operator== (equal objects, equal hashes). A tolerance-based equality
+    /// cannot be hashed that way (two equal objects can lie on both sides of a cell boundary): hash the
+    /// cell of the object, with cells at least as large as the tolerance, and provide `hash_cells()`,
+    /// the hashes of all the cells that can hold an object equal to this one (its own cell and the
+    /// neighbouring ones). Lookups then compare the children of these cells only.
+    template <typename T>
+    struct has_hash {
+        template <typename U>
+        static auto test(int) -> decltype(size_t(std::declval<const U&>().hash()), std::true_type());
+
+        template <typename>
+        static std::false_type test(...);
+
+        static constexpr bool value = decltype(test<T>(0))::value;
+    };
+
+    /// `hash_cells() const`: range of the hashes to probe for the objects equal to this one
+    template <typename T>
+    struct has_hash_cells {
+        template <typename U>
+        static auto test(int) -> decltype(size_t(*std::begin(std::declval<const U&>().hash_cells())), std::true_type());
+
+        template <typename>
+        static std::false_type test(...);
+
+        static constexpr bool value = decltype(test<T>(0))::value;
+    };
+
+    /// boost-like hash combination (for user hash() functions)
+    template <typename T>
+    inline void hash_combine(size_t& seed, const T& v)
+    {
+        seed ^= std::hash<T>()(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+
+    /// Lookup of the children of a node/action by their key (action or state). Keys without hash()
+    /// are searched linearly; otherwise an index is built once there are more than `Linear` children
+    /// and it catches up with the children appended since the last lookup.
+    template <typename Key, bool Hashed = has_hash<Key>::value, size_t Linear = 8>
+    class ChildIndex {
+    public:
+        template <typename Children, typename GetKey>
+        typename Children::value_type find(const Children& children, const Key& key, GetKey get)
+        {
+            auto it = std::find_if(children.begin(), children.end(), [&](typename Children::value_type const& p) { return get(p) == key; });
+            if (it == children.end())
+                return nullptr;
+            return *it;
+        }
+
+        void clear() {}
+    };
+
+    template <typename Key, size_t Linear>
+    class ChildIndex<Key, true, Linear> {
+    public:
+        ChildIndex() : _indexed(0) {}
+
+        template <typename Children, typename GetKey>
+        typename Children::value_type find(const Children& children, const Key& key, GetKey get)
+        {
+            if (children.size() <= Linear)
+                return ChildIndex<Key, false, Linear>().find(children, key, get);
+
+            for (; _indexed < children.size(); _indexed++)
+                _index.emplace(get(children[_indexed]).hash(), _indexed);
+
+            // the first match in children order, as with the linear search
+            size_t best = children.size();
+            _probe(children, key, get, best, std::integral_constant<bool, has_hash_cells<Key>::value>());
+
+            if (best == children.size())
+                return nullptr;
+            return children[best];
+        }
+
+        /// to be called when children are removed or reordered
+        void clear()
+        {
+            _index.clear();
+            _indexed = 0;
+        }
+
+    protected:
+        template <typename Children, typename GetKey>
+        void _probe(const Children& children, const Key& key, GetKey& get, size_t& best, std::true_type) const
+        {
+            for (size_t cell : key.hash_cells())
+                _probe_cell(children, key, get, best, cell);
+        }
+
+        template <typename Children, typename GetKey>
+        void _probe(const Children& children, const Key& key, GetKey& get, size_t& best, std::false_type) const
+        {
+            _probe_cell(children, key, get, best, key.hash());
+        }
+
+        template <typename Children, typename GetKey>
+        void _probe_cell(const Children& children, const Key& key, GetKey& get, size_t& best, size_t cell) const
+        {
+            auto range = _index.equal_range(cell);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (it->second < best && get(children[it->second]) == key)
+                    best = it->second;
+            }
+        }
+
+        std::unordered_multimap<size_t, size_t> _index;
+        size_t _indexed;
+    };
+}
+
+#endif
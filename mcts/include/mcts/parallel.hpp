@@ -3,16 +3,21 @@
 
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <thread>
 
 #ifdef USE_TBB
 #include <tbb/concurrent_vector.h>
-#include <tbb/task_scheduler_init.h>
 #include <tbb/parallel_for.h>
 #include <tbb/parallel_for_each.h>
 #include <tbb/parallel_sort.h>
 #include <tbb/parallel_reduce.h>
 #include <tbb/parallel_invoke.h>
 #include <tbb/blocked_range.h>
+// oneTBB (interface version 12000+) removed task_scheduler_init
+#if TBB_INTERFACE_VERSION < 12000
+#include <tbb/task_scheduler_init.h>
+#endif
 #endif
 
 namespace mcts {
@@ -45,16 +50,71 @@ namespace mcts {
 #ifdef USE_TBB
         inline void init()
         {
+#if TBB_INTERFACE_VERSION < 12000
             static tbb::task_scheduler_init init;
+#endif
         }
 #else
         /// @ingroup par_tools
         /// init TBB (if activated) for multi-core computing
-        void init()
+        inline void init()
         {
         }
 #endif
 
+        /// @ingroup par_tools
+        /// minimal spin lock (BasicLockable) for short critical sections
+        class SpinLock {
+        public:
+            SpinLock() {}
+            SpinLock(const SpinLock&) = delete;
+            SpinLock& operator=(const SpinLock&) = delete;
+
+            void lock()
+            {
+                while (_flag.test_and_set(std::memory_order_acquire))
+                    std::this_thread::yield();
+            }
+
+            bool try_lock()
+            {
+                return !_flag.test_and_set(std::memory_order_acquire);
+            }
+
+            void unlock()
+            {
+                _flag.clear(std::memory_order_release);
+            }
+
+        protected:
+            std::atomic_flag _flag = ATOMIC_FLAG_INIT;
+        };
+
+        /// @ingroup par_tools
+        /// work units of `workers` workers with `quota` units each: with TBB, the workers draw from a
+        /// shared pool of quota * workers units (the fast ones do the work left by the slow ones);
+        /// without, the workers run one after the other and each one gets its quota
+        class Budget {
+        public:
+            Budget(size_t quota, size_t workers) : _quota(quota), _total(quota * workers), _taken(0) {}
+            Budget(const Budget&) = delete;
+            Budget& operator=(const Budget&) = delete;
+
+            /// draw one unit for a worker that did `done` units so far (false: no unit left)
+            bool take(size_t done)
+            {
+#ifdef USE_TBB
+                return _taken.fetch_add(1, std::memory_order_relaxed) < _total;
+#else
+                return done < _quota;
+#endif
+            }
+
+        protected:
+            size_t _quota, _total;
+            std::atomic<size_t> _taken;
+        };
+
         ///@ingroup par_tools
         /// parallel for
         template <typename F>
@@ -0,0 +1,133 @@
+#ifndef MCTS_RANDOM_HPP
+#define MCTS_RANDOM_HPP
+
+#include <cstdint>
+#include <atomic>
+#include <random>
+
+namespace mcts {
+    /// Random numbers for policies and user states: every thread draws from its own engine (no shared lock),
+    /// and all the engines derive from one global seed so that runs can be repeated.
+    namespace rng {
+        using engine_type = std::mt19937_64;
+
+        inline std::atomic<uint64_t>& _global_seed()
+        {
+            static std::atomic<uint64_t> seed(5489u);
+            return seed;
+        }
+
+        // bumped by seed() so that the engines of the other threads are re-derived
+        inline std::atomic<uint64_t>& _generation()
+        {
+            static std::atomic<uint64_t> generation(0);
+            return generation;
+        }
+
+        inline uint64_t _thread_index()
+        {
+            static std::atomic<uint64_t> count(0);
+            thread_local uint64_t index = count.fetch_add(1);
+            return index;
+        }
+
+        struct _ThreadEngine {
+            engine_type engine;
+            uint64_t generation = uint64_t(-1);
+        };
+
+        inline _ThreadEngine& _thread_engine()
+        {
+            thread_local _ThreadEngine e;
+            return e;
+        }
+
+        inline void _reseed(engine_type& engine, uint64_t seed, uint64_t stream)
+        {
+            std::seed_seq seq{uint32_t(seed), uint32_t(seed >> 32), uint32_t(stream), uint32_t(stream >> 32)};
+            engine.seed(seq);
+        }
+
+        /// set the global seed; the calling thread restarts from stream 0
+        inline void seed(uint64_t s)
+        {
+            _global_seed() = s;
+            uint64_t generation = _generation().fetch_add(1) + 1;
+            _ThreadEngine& e = _thread_engine();
+            _reseed(e.engine, s, 0);
+            e.generation = generation;
+        }
+
+        inline uint64_t seed()
+        {
+            return _global_seed();
+        }
+
+        /// engine of the calling thread
+        inline engine_type& engine()
+        {
+            _ThreadEngine& e = _thread_engine();
+            uint64_t generation = _generation().load(std::memory_order_relaxed);
+            if (e.generation != generation) {
+                _reseed(e.engine, _global_seed(), _thread_index() + 1);
+                e.generation = generation;
+            }
+            return e.engine;
+        }
+
+        /// restart the stream of the calling thread (e.g. with a seed from split())
+        inline void reseed(uint64_t s)
+        {
+            _ThreadEngine& e = _thread_engine();
+            _reseed(e.engine, s, 0);
+            e.generation = _generation().load(std::memory_order_relaxed);
+        }
+
+        /// runs the calling thread on the stream `s` until the end of the scope, then gives it its previous
+        /// stream back (e.g. a parallel root on a worker that goes on with the rest of the caller's work)
+        class ScopedStream {
+        public:
+            explicit ScopedStream(uint64_t s) : _saved(_thread_engine())
+            {
+                reseed(s);
+            }
+
+            ScopedStream(const ScopedStream&) = delete;
+            ScopedStream& operator=(const ScopedStream&) = delete;
+
+            ~ScopedStream()
+            {
+                _thread_engine() = _saved;
+            }
+
+        protected:
+            _ThreadEngine _saved;
+        };
+
+        /// draw the seed of a new stream from the calling thread
+        inline uint64_t split()
+        {
+            return engine()();
+        }
+
+        /// uniform in [a, b)
+        inline double uniform(double a = 0.0, double b = 1.0)
+        {
+            return std::uniform_real_distribution<double>(a, b)(engine());
+        }
+
+        /// uniform in [a, b]
+        template <typename T>
+        inline T uniform_int(T a, T b)
+        {
+            return std::uniform_int_distribution<T>(a, b)(engine());
+        }
+
+        inline double gaussian(double mean = 0.0, double sigma = 1.0)
+        {
+            return std::normal_distribution<double>(mean, sigma)(engine());
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef MCTS_SIMD_HPP
+#define MCTS_SIMD_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace mcts {
+    /// Argmax kernels over the child statistics of a node (structure of arrays: summed values, and
+    /// integer visit counts converted to double). They return the first index with the highest score
+    /// (n if no score is above -max, e.g. n == 0), exactly like a scalar loop with a strict comparison.
+    namespace simd {
+        // score = value / (visits + eps) [+ k * sqrt(log_n / (visits + eps))]
+        template <bool Explore>
+        inline double _score(double value, double visits, double log_n, double k, double eps)
+        {
+            double n = visits + eps;
+            if (Explore)
+                return value / n + k * std::sqrt(log_n / n);
+            return value / n;
+        }
+
+        // scalar kernel from index i (with the best score so far); any value type, computed in double
+        template <bool Explore, typename T>
+        inline size_t _argmax_from(const T* values, const uint32_t* visits, size_t n, size_t i, double best, size_t best_i, double log_n, double k, double eps)
+        {
+            for (; i < n; i++) {
+                double d = _score<Explore>(values[i], visits[i], log_n, k, eps);
+                if (d > best) {
+                    best = d;
+                    best_i = i;
+                }
+            }
+
+            return best_i;
+        }
+
+        // float statistics (see MCTS_FLOAT_STATS): scalar only
+        template <bool Explore>
+        inline size_t _argmax(const float* values, const uint32_t* visits, size_t n, double log_n, double k, double eps)
+        {
+            return _argmax_from<Explore>(values, visits, n, 0, -std::numeric_limits<double>::max(), n, log_n, k, eps);
+        }
+
+        template <bool Explore>
+        inline size_t _argmax(const double* values, const uint32_t* visits, size_t n, double log_n, double k, double eps)
+        {
+            double best = -std::numeric_limits<double>::max();
+            size_t best_i = n;
+            size_t i = 0;
+
+#ifdef __AVX2__
+            if (n >= 4) {
+                const __m256d v_eps = _mm256_set1_pd(eps);
+                const __m256d v_k = _mm256_set1_pd(k);
+                const __m256d v_log_n = _mm256_set1_pd(log_n);
+                const __m256d v_four = _mm256_set1_pd(4.0);
+                // unsigned to double: the counts are shifted to the signed range, converted, and shifted back
+                const __m128i v_sign = _mm_set1_epi32(int32_t(0x80000000u));
+                const __m256d v_offset = _mm256_set1_pd(2147483648.0);
+                __m256d v_best = _mm256_set1_pd(best);
+                __m256d v_best_i = _mm256_set1_pd(double(n));
+                __m256d v_i = _mm256_set_pd(3.0, 2.0, 1.0, 0.0);
+
+                for (; i + 4 <= n; i += 4) {
+                    __m128i v_visits = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(visits + i)), v_sign);
+                    __m256d v_n = _mm256_add_pd(_mm256_add_pd(_mm256_cvtepi32_pd(v_visits), v_offset), v_eps);
+                    __m256d v_score = _mm256_div_pd(_mm256_loadu_pd(values + i), v_n);
+                    if (Explore)
+                        v_score = _mm256_add_pd(v_score, _mm256_mul_pd(v_k, _mm256_sqrt_pd(_mm256_div_pd(v_log_n, v_n))));
+                    // strict comparison: every lane keeps its first maximum
+                    __m256d better = _mm256_cmp_pd(v_score, v_best, _CMP_GT_OQ);
+                    v_best = _mm256_blendv_pd(v_best, v_score, better);
+                    v_best_i = _mm256_blendv_pd(v_best_i, v_i, better);
+                    v_i = _mm256_add_pd(v_i, v_four);
+                }
+
+                double lane_best[4], lane_i[4];
+                _mm256_storeu_pd(lane_best, v_best);
+                _mm256_storeu_pd(lane_i, v_best_i);
+                for (size_t l = 0; l < 4; l++) {
+                    size_t li = size_t(lane_i[l]);
+                    if (li < n && (lane_best[l] > best || (lane_best[l] == best && li < best_i))) {
+                        best = lane_best[l];
+                        best_i = li;
+                    }
+                }
+            }
+#endif
+
+            return _argmax_from<Explore>(values, visits, n, i, best, best_i, log_n, k, eps);
+        }
+
+        /// UCT: value / (visits + eps) + k * sqrt(log_n / (visits + eps))
+        template <typename T>
+        inline size_t uct_argmax(const T* values, const uint32_t* visits, size_t n, double log_n, double k, double eps)
+        {
+            return _argmax<true>(values, visits, n, log_n, k, eps);
+        }
+
+        /// mean value: value / (visits + eps)
+        template <typename T>
+        inline size_t greedy_argmax(const T* values, const uint32_t* visits, size_t n, double eps)
+        {
+            return _argmax<false>(values, visits, n, 0.0, 0.0, eps);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef MCTS_SMALL_VECTOR_HPP
+#define MCTS_SMALL_VECTOR_HPP
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+namespace mcts {
+
+    /// Vector of trivially copyable values (pointers, numbers) whose first N elements are stored inline:
+    /// it does not allocate while it holds at most N of them. The next ones go to a heap vector whose
+    /// capacity is kept by clear(), so that a reused SmallVector stops allocating after its longest use.
+    template <typename T, size_t N>
+    class SmallVector {
+    public:
+        SmallVector() : _size(0) {}
+
+        void push_back(const T& value)
+        {
+            if (_size < N)
+                _inline[_size] = value;
+            else
+                _heap.push_back(value);
+            _size++;
+        }
+
+        void clear()
+        {
+            _heap.clear();
+            _size = 0;
+        }
+
+        size_t size() const
+        {
+            return _size;
+        }
+
+        bool empty() const
+        {
+            return _size == 0;
+        }
+
+        T& operator[](size_t i)
+        {
+            return (i < N) ? _inline[i] : _heap[i - N];
+        }
+
+        const T& operator[](size_t i) const
+        {
+            return (i < N) ? _inline[i] : _heap[i - N];
+        }
+
+    protected:
+        std::array<T, N> _inline;
+        std::vector<T> _heap;
+        size_t _size;
+    };
+}
+
+#endif
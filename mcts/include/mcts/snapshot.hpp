@@ -0,0 +1,193 @@
+#ifndef MCTS_SNAPSHOT_HPP
+#define MCTS_SNAPSHOT_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace mcts {
+
+    /// Binary snapshots of trees for offline analysis (see src/tools/snapshot_reader.cpp).
+    /// Format (native byte order): "MCTSSNAP", uint32 version, then the root node, depth first.
+    /// node: uint32 visits, uint32 size + state bytes, uint32 number of actions, then its actions;
+    /// action: uint32 visits, double value (sum of the returns), uint32 size + action bytes,
+    /// uint32 number of outcomes, then its outcome nodes.
+    namespace snapshot {
+        const char magic[8] = {'M', 'C', 'T', 'S', 'S', 'N', 'A', 'P'};
+        const uint32_t version = 1;
+
+        /// append the bytes of a trivially copyable value (for the serializers of states and actions)
+        template <typename T>
+        void put(std::string& out, const T& value)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable values can be copied as bytes");
+            out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        /// serializers are called as serializer(out, value) and append the value to out;
+        /// this one appends the bytes of the value (trivially copyable states and actions)
+        struct RawSerializer {
+            template <typename T>
+            void operator()(std::string& out, const T& value) const
+            {
+                put(out, value);
+            }
+        };
+
+        template <typename T, typename Serializer>
+        void _put_sized(std::string& out, const T& value, Serializer& serializer)
+        {
+            size_t at = out.size();
+            put(out, uint32_t(0));
+            serializer(out, value);
+            uint32_t size = uint32_t(out.size() - at - sizeof(uint32_t));
+            std::memcpy(&out[at], &size, sizeof(size));
+        }
+
+        // with a stream, the bytes are written out once they reach `chunk` (between two nodes)
+        const size_t chunk = 1 << 16;
+
+        template <typename Node, typename StateSerializer, typename ActionSerializer>
+        void _put_node(std::string& out, const Node& node, StateSerializer& ss, ActionSerializer& as, std::ostream* stream)
+        {
+            if (stream && out.size() >= chunk) {
+                stream->write(out.data(), out.size());
+                out.clear();
+            }
+            put(out, uint32_t(node.visits()));
+            _put_sized(out, *node.state(), ss);
+            put(out, uint32_t(node.children().size()));
+            for (const auto& action : node.children()) {
+                put(out, uint32_t(action->visits()));
+                put(out, double(action->value()));
+                _put_sized(out, action->action(), as);
+                put(out, uint32_t(action->children().size()));
+                for (const auto& child : action->children())
+                    _put_node(out, *child, ss, as, stream);
+            }
+        }
+
+        /// snapshot of a tree (or subtree); the tree must not be searched at the same time
+        template <typename Node, typename StateSerializer = RawSerializer, typename ActionSerializer = RawSerializer>
+        std::string take(const Node& root, StateSerializer ss = StateSerializer(), ActionSerializer as = ActionSerializer())
+        {
+            std::string out(magic, sizeof(magic));
+            put(out, version);
+            _put_node(out, root, ss, as, nullptr);
+            return out;
+        }
+
+        /// write the snapshot of a tree (or subtree) to a stream while it is serialized (only a chunk of it is
+        /// held in memory); the tree must not be searched at the same time. False if the stream failed.
+        template <typename Node, typename StateSerializer = RawSerializer, typename ActionSerializer = RawSerializer>
+        bool write(std::ostream& stream, const Node& root, StateSerializer ss = StateSerializer(), ActionSerializer as = ActionSerializer())
+        {
+            std::string out(magic, sizeof(magic));
+            put(out, version);
+            _put_node(out, root, ss, as, &stream);
+            stream.write(out.data(), out.size());
+            return bool(stream);
+        }
+
+        template <typename T>
+        bool _get(std::istream& in, T& value)
+        {
+            return bool(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+        }
+
+        inline bool _get_sized(std::istream& in, std::string& bytes)
+        {
+            uint32_t size;
+            if (!_get(in, size))
+                return false;
+            bytes.resize(size);
+            return size == 0 || bool(in.read(&bytes[0], size));
+        }
+
+        template <typename Visitor>
+        bool _read_node(std::istream& in, Visitor& visitor, size_t depth)
+        {
+            uint32_t visits, actions;
+            std::string bytes;
+            if (!_get(in, visits) || !_get_sized(in, bytes) || !_get(in, actions))
+                return false;
+            visitor.node(depth, visits, bytes);
+
+            for (uint32_t a = 0; a < actions; a++) {
+                uint32_t action_visits, outcomes;
+                double value;
+                if (!_get(in, action_visits) || !_get(in, value) || !_get_sized(in, bytes) || !_get(in, outcomes))
+                    return false;
+                visitor.action(depth, action_visits, value, bytes);
+                for (uint32_t o = 0; o < outcomes; o++)
+                    if (!_read_node(in, visitor, depth + 1))
+                        return false;
+            }
+
+            return true;
+        }
+
+        /// read a snapshot node by node (the tree is never held in memory): visitor.node(depth, visits, state)
+        /// and visitor.action(depth, visits, value, action) are called depth first, with the serialized
+        /// states and actions (std::string of bytes). False if the stream is not a (complete) snapshot.
+        template <typename Visitor>
+        bool read(std::istream& in, Visitor& visitor)
+        {
+            char m[sizeof(magic)];
+            uint32_t v;
+            if (!in.read(m, sizeof(m)) || std::memcmp(m, magic, sizeof(m)) != 0 || !_get(in, v) || v != version)
+                return false;
+            return _read_node(in, visitor, 0);
+        }
+
+        /// writes snapshots in the background: write() returns at once, and a thread serializes the tree and
+        /// streams it to the file (see snapshot::write()). The writer keeps the root (and thus the tree) alive
+        /// until the file is written; the tree must not be searched or modified until then (wait(), or the next
+        /// write()). The caller can search another tree in the meantime: a new one, or the subtree given by
+        /// MCTSNode::reroot() when the storage copies it (ArenaStorage). One file at a time (a write waits for
+        /// the previous one).
+        class AsyncWriter {
+        public:
+            AsyncWriter() : _ok(true) {}
+            AsyncWriter(const AsyncWriter&) = delete;
+            AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+            ~AsyncWriter()
+            {
+                wait();
+            }
+
+            template <typename Node, typename StateSerializer = RawSerializer, typename ActionSerializer = RawSerializer>
+            void write(const std::string& file, const std::shared_ptr<Node>& root, StateSerializer ss = StateSerializer(), ActionSerializer as = ActionSerializer())
+            {
+                wait();
+                _thread = std::thread([this, file, root, ss, as]() {
+                    std::ofstream out(file.c_str(), std::ios::binary);
+                    _ok = snapshot::write(out, *root, ss, as);
+                });
+            }
+
+            /// wait for the file being written; false if the last write failed
+            bool wait()
+            {
+                if (_thread.joinable())
+                    _thread.join();
+                return _ok;
+            }
+
+        protected:
+            std::thread _thread;
+            // only accessed by the writing thread until it is joined
+            bool _ok;
+        };
+    }
+}
+
+#endif
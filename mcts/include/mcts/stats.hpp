@@ -0,0 +1,102 @@
+#ifndef MCTS_STATS_HPP
+#define MCTS_STATS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <vector>
+
+namespace mcts {
+
+    /// Counters of the searches run from a root (see MCTSNode::stats()). They are only recorded
+    /// when compiled with -DMCTS_STATS; otherwise nothing is measured and they stay at 0.
+    struct SearchStats {
+        size_t iterations = 0;
+        // nodes added by the iterations (the adopted subtrees of merges are not counted)
+        size_t expansions = 0;
+        size_t rollouts = 0;
+        size_t rollout_steps = 0;
+        // parallel roots merged into this tree
+        size_t merges = 0;
+        // nanoseconds spent in each phase, summed over the iterations (and threads)
+        uint64_t select_ns = 0;
+        uint64_t expand_ns = 0;
+        uint64_t simulate_ns = 0;
+        uint64_t backprop_ns = 0;
+        uint64_t merge_ns = 0;
+
+        // shape of the tree when the stats were taken: nodes and actions at every depth (root: 0)
+        std::vector<size_t> depth_nodes;
+        std::vector<size_t> depth_actions;
+
+        size_t nodes() const
+        {
+            size_t n = 0;
+            for (size_t d : depth_nodes)
+                n += d;
+            return n;
+        }
+
+        /// mean number of actions of the nodes at a depth
+        double branching(size_t depth) const
+        {
+            return (depth < depth_nodes.size() && depth_nodes[depth] > 0) ? double(depth_actions[depth]) / double(depth_nodes[depth]) : 0.0;
+        }
+
+        double mean_rollout_length() const
+        {
+            return (rollouts > 0) ? double(rollout_steps) / double(rollouts) : 0.0;
+        }
+
+        /// add the counters of another search (the shape is not added)
+        SearchStats& operator+=(const SearchStats& other)
+        {
+            iterations += other.iterations;
+            expansions += other.expansions;
+            rollouts += other.rollouts;
+            rollout_steps += other.rollout_steps;
+            merges += other.merges;
+            select_ns += other.select_ns;
+            expand_ns += other.expand_ns;
+            simulate_ns += other.simulate_ns;
+            backprop_ns += other.backprop_ns;
+            merge_ns += other.merge_ns;
+            return *this;
+        }
+    };
+
+    /// counters of one iteration (or merge) before they are added to the tree:
+    /// lap() adds the time since the previous lap to a phase, count() increments a counter
+    class StatsRecorder {
+    public:
+#ifdef MCTS_STATS
+        StatsRecorder() : _last(std::chrono::steady_clock::now()) {}
+
+        void lap(uint64_t SearchStats::*phase)
+        {
+            auto now = std::chrono::steady_clock::now();
+            _stats.*phase += std::chrono::duration_cast<std::chrono::nanoseconds>(now - _last).count();
+            _last = now;
+        }
+
+        void count(size_t SearchStats::*counter, size_t n = 1)
+        {
+            _stats.*counter += n;
+        }
+
+        const SearchStats& stats() const
+        {
+            return _stats;
+        }
+
+    protected:
+        std::chrono::steady_clock::time_point _last;
+        SearchStats _stats;
+#else
+        void lap(uint64_t SearchStats::*) {}
+        void count(size_t SearchStats::*, size_t = 1) {}
+#endif
+    };
+}
+
+#endif
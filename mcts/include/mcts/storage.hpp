@@ -0,0 +1,191 @@
+#ifndef MCTS_STORAGE_HPP
+#define MCTS_STORAGE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+#include <mcts/parallel.hpp>
+
+namespace mcts {
+
+    /// Bump allocator that hands out memory from large chunks and releases all of it at once
+    /// (when the arena is destroyed). Individual deallocations are no-ops. The allocations only take a lock
+    /// while a SharedScope is open (trees grown by several threads, see MCTSNode::compute_tree_parallel()).
+    class Arena {
+    public:
+        /// the arenas lock their allocations while an object of this type lives
+        struct SharedScope {
+            SharedScope()
+            {
+                _shared_scopes().fetch_add(1);
+            }
+
+            SharedScope(const SharedScope&) = delete;
+            SharedScope& operator=(const SharedScope&) = delete;
+
+            ~SharedScope()
+            {
+                _shared_scopes().fetch_sub(1);
+            }
+        };
+
+        Arena(size_t chunk_size = 1 << 16) : _chunk_size(chunk_size), _ptr(nullptr), _end(nullptr), _allocated(0), _reserved(0) {}
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        ~Arena()
+        {
+            for (auto chunk : _chunks)
+                ::operator delete(chunk);
+        }
+
+        void* allocate(size_t size, size_t alignment)
+        {
+            // opened before the threads start: the serial searches never pay for the lock
+            if (_shared_scopes().load(std::memory_order_relaxed) > 0) {
+                std::lock_guard<par::SpinLock> lock(_lock);
+                return _allocate(size, alignment);
+            }
+            return _allocate(size, alignment);
+        }
+
+        size_t allocated() const
+        {
+            return _allocated;
+        }
+
+        size_t reserved() const
+        {
+            return _reserved;
+        }
+
+    protected:
+        size_t _chunk_size;
+        std::vector<char*> _chunks;
+        char *_ptr, *_end;
+        size_t _allocated, _reserved;
+        par::SpinLock _lock;
+
+        static std::atomic<int>& _shared_scopes()
+        {
+            static std::atomic<int> scopes(0);
+            return scopes;
+        }
+
+        void* _allocate(size_t size, size_t alignment)
+        {
+            uintptr_t p = _align(reinterpret_cast<uintptr_t>(_ptr), alignment);
+            if (_ptr == nullptr || p + size > reinterpret_cast<uintptr_t>(_end)) {
+                size_t bytes = std::max(_chunk_size, size + alignment);
+                char* chunk = static_cast<char*>(::operator new(bytes));
+                _chunks.push_back(chunk);
+                _end = chunk + bytes;
+                _reserved += bytes;
+                p = _align(reinterpret_cast<uintptr_t>(chunk), alignment);
+            }
+
+            _ptr = reinterpret_cast<char*>(p + size);
+            _allocated += size;
+            return reinterpret_cast<void*>(p);
+        }
+
+        static uintptr_t _align(uintptr_t p, size_t alignment)
+        {
+            return (p + alignment - 1) & ~(uintptr_t(alignment) - 1);
+        }
+    };
+
+    /// STL allocator on top of an Arena. Every copy shares ownership of the arena,
+    /// so the memory stays valid as long as one object allocated from it is alive.
+    template <typename T>
+    class ArenaAllocator {
+    public:
+        using value_type = T;
+
+        ArenaAllocator(const std::shared_ptr<Arena>& arena) : _arena(arena) {}
+
+        template <typename U>
+        ArenaAllocator(const ArenaAllocator<U>& other) : _arena(other.arena()) {}
+
+        T* allocate(size_t n)
+        {
+            return static_cast<T*>(_arena->allocate(n * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T*, size_t) {}
+
+        const std::shared_ptr<Arena>& arena() const
+        {
+            return _arena;
+        }
+
+        template <typename U>
+        bool operator==(const ArenaAllocator<U>& other) const
+        {
+            return _arena == other.arena();
+        }
+
+        template <typename U>
+        bool operator!=(const ArenaAllocator<U>& other) const
+        {
+            return _arena != other.arena();
+        }
+
+    protected:
+        std::shared_ptr<Arena> _arena;
+    };
+
+    /// Node storage policies: every node and action of a tree is created through the storage of its root.
+    /// Both hand out std::shared_ptr handles (with their atomic reference counts): the storage only
+    /// decides where the nodes, actions and states are allocated. `frees_nodes` tells whether the memory
+    /// of a node is released when the node dies (otherwise MCTSNode::reroot() copies the kept subtree), and
+    /// a SharedScope is held while several threads grow a tree (and allocate from its storage) at once.
+
+    /// one heap allocation per node/action (default)
+    struct HeapStorage {
+        static constexpr bool frees_nodes = true;
+        // the heap is thread-safe
+        struct SharedScope {};
+
+        template <typename T, typename... Args>
+        std::shared_ptr<T> make(Args&&... args)
+        {
+            return std::make_shared<T>(std::forward<Args>(args)...);
+        }
+    };
+
+    /// bump allocation only: all nodes/actions of a tree live in a shared arena that is freed in bulk with
+    /// the tree; nothing is freed (or reused) before that (see the *_arena cases of suite.cpp for the
+    /// comparison with HeapStorage)
+    class ArenaStorage {
+    public:
+        static constexpr bool frees_nodes = false;
+        using SharedScope = Arena::SharedScope;
+
+        template <typename T, typename... Args>
+        std::shared_ptr<T> make(Args&&... args)
+        {
+            // the arena is created lazily, so default-constructed storages are cheap
+            if (!_arena)
+                _arena = std::make_shared<Arena>();
+            return std::allocate_shared<T>(ArenaAllocator<T>(_arena), std::forward<Args>(args)...);
+        }
+
+        const std::shared_ptr<Arena>& arena() const
+        {
+            return _arena;
+        }
+
+    protected:
+        std::shared_ptr<Arena> _arena;
+    };
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef MCTS_TRANSPOSITION_HPP
+#define MCTS_TRANSPOSITION_HPP
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+#include <mcts/parallel.hpp>
+
+namespace mcts {
+
+    /// Fixed-size table of state values shared by the trees of a search (e.g. the parallel roots), indexed
+    /// by State::hash() (see hash.hpp). Each slot holds one state (a copy, so State has to be default
+    /// constructible and copy-assignable) and the statistics of the states equal to it (operator==). A state
+    /// that is not equal to the state of its slot (a hash collision, or a state of the same cell outside of
+    /// the equality tolerance) replaces it and starts from empty statistics; it is never merged with it.
+    template <typename State>
+    class TranspositionTable {
+    public:
+        TranspositionTable(size_t size = 1 << 16) : _slots(_power_of_two(size)), _mask(_slots.size() - 1) {}
+
+        TranspositionTable(const TranspositionTable&) = delete;
+        TranspositionTable& operator=(const TranspositionTable&) = delete;
+
+        /// add `visits` returns summing to `value` to the entry of the state
+        void update(const State& state, double value, size_t visits = 1)
+        {
+            size_t hash = state.hash();
+            Slot& slot = _slots[hash & _mask];
+            std::lock_guard<par::SpinLock> lock(slot.lock);
+            if (slot.visits == 0 || slot.hash != hash || !(slot.state == state)) {
+                slot.hash = hash;
+                slot.state = state;
+                slot.value = 0.0;
+                slot.visits = 0;
+            }
+            slot.value += value;
+            slot.visits += visits;
+        }
+
+        /// mean value of the state (false if the table does not know it)
+        bool lookup(const State& state, double& mean, size_t& visits)
+        {
+            size_t hash = state.hash();
+            Slot& slot = _slots[hash & _mask];
+            std::lock_guard<par::SpinLock> lock(slot.lock);
+            if (slot.visits == 0 || slot.hash != hash || !(slot.state == state))
+                return false;
+            mean = slot.value / double(slot.visits);
+            visits = slot.visits;
+            return true;
+        }
+
+        size_t size() const
+        {
+            return _slots.size();
+        }
+
+    protected:
+        struct Slot {
+            size_t hash = 0;
+            State state;
+            double value = 0.0;
+            size_t visits = 0;
+            par::SpinLock lock;
+        };
+
+        std::vector<Slot> _slots;
+        size_t _mask;
+
+        // the slot of a state is then a mask of its hash
+        static size_t _power_of_two(size_t size)
+        {
+            size_t n = 1;
+            while (n < size)
+                n <<= 1;
+            return n;
+        }
+    };
+}
+
+#endif
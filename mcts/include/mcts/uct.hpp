@@ -3,30 +3,72 @@
 
 #include <cassert>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
 #include <memory>
 #include <vector>
 #include <utility>
 #include <mutex>
+#include <type_traits>
+#include <mcts/candidates.hpp>
 #include <mcts/defaults.hpp>
+#include <mcts/hash.hpp>
 #include <mcts/macros.hpp>
 #include <mcts/parallel.hpp>
+#include <mcts/small_vector.hpp>
+#include <mcts/stats.hpp>
+#include <mcts/storage.hpp>
+#include <mcts/transposition.hpp>
 
 namespace mcts {
 
+    /// type of the summed returns of the children of the nodes (see MCTSNode::child_values()): double, or
+    /// float with -DMCTS_FLOAT_STATS to halve them (the sums are then only precise to ~7 digits, e.g. they
+    /// stop growing past 1e8 for rewards of 10)
+#ifdef MCTS_FLOAT_STATS
+    using stat_type = float;
+#else
+    using stat_type = double;
+#endif
+
+    /// visit counts of the children (see MCTSNode::child_visits()): exact integers, converted by the
+    /// selection kernels
+    using visit_type = uint32_t;
+
+    /// parameters of a tree, shared by all its nodes (and by the parallel roots of its searches)
+    template <typename State>
+    struct TreeContext {
+        TreeContext(size_t depth, double g) : rollout_depth(depth), gamma(g) {}
+
+        size_t rollout_depth;
+        double gamma;
+        // value estimates shared with other trees (see MCTSNode::set_transposition_table())
+        std::shared_ptr<TranspositionTable<State>> table;
+    };
+
     template <typename Params, typename NodeType, typename OutcomeSelection, typename ActionType = size_t>
     class MCTSAction : public std::enable_shared_from_this<MCTSAction<Params, NodeType, OutcomeSelection, ActionType>> {
     public:
         using action_type = MCTSAction<Params, NodeType, OutcomeSelection, ActionType>;
         using node_ptr = std::shared_ptr<NodeType>;
+        using state_type = typename NodeType::state_type;
+
+        // the parent is a plain pointer: nodes own their actions and actions own their children
+        MCTSAction(const ActionType& action, NodeType* parent) : _parent(parent), _action(action), _index(0) {}
 
-        MCTSAction(const ActionType& action, const node_ptr& parent, double value) : _parent(parent), _action(action), _value(value), _visits(0) {}
+        NodeType* parent() const
+        {
+            return _parent;
+        }
 
-        node_ptr parent()
+        NodeType*& parent()
         {
             return _parent;
         }
 
-        std::vector<node_ptr> children() const
+        const std::vector<node_ptr>& children() const
         {
             return _children;
         }
@@ -36,29 +78,33 @@ namespace mcts {
             return _children;
         }
 
-        ActionType action() const
+        const ActionType& action() const
         {
             return _action;
         }
 
-        size_t visits() const
+        /// child node whose state is equal to `state` (nullptr if there is none)
+        node_ptr find_child(const state_type& state)
         {
-            return _visits;
+            return _children_index.find(_children, state, [](const node_ptr& p) -> const state_type& { return *(p->state()); });
         }
 
-        size_t& visits()
+        /// position of the action in the children (and statistics) of its parent
+        size_t index() const
         {
-            return _visits;
+            return _index;
         }
 
-        double value() const
+        /// the statistics live in the parent (see MCTSNode::child_visits()); on a shared tree, they are read
+        /// with the lock of the parent held (as node_locked() does)
+        size_t visits() const
         {
-            return _value;
+            return _parent->child_visits()[_index];
         }
 
-        double& value()
+        double value() const
         {
-            return _value;
+            return _parent->child_values()[_index];
         }
 
         bool operator==(const MCTSAction& other) const
@@ -71,50 +117,70 @@ namespace mcts {
             return OutcomeSelection()(this->shared_from_this());
         }
 
-        void update_stats(double value)
+        /// outcome selection for trees shared between threads, with the lock of the parent (the outcome
+        /// policy reads the statistics of the action and may modify its children)
+        node_ptr node_locked()
+        {
+            std::lock_guard<par::SpinLock> lock(_parent->_lock);
+            return OutcomeSelection()(this->shared_from_this());
+        }
+
+        /// the statistics live in the parent (see MCTSNode::child_values());
+        /// on a shared tree, the lock of the parent has to be held
+        void update_stats(double value, size_t visits = 1)
         {
-            _value += value;
-            _visits++;
+            _parent->_update_child(_index, value, visits);
         }
 
     protected:
-        node_ptr _parent;
+        friend NodeType;
+
+        NodeType* _parent;
         std::vector<node_ptr> _children;
         ActionType _action;
-        double _value;
-        size_t _visits;
+        uint32_t _index;
+        ChildIndex<state_type> _children_index;
     };
 
-    template <typename Params, typename State, typename StateInit, typename ValueInit, typename ActionValue, typename DefaultPolicy, typename Action, typename SelectionPolicy, typename OutcomeSelection>
-    class MCTSNode : public std::enable_shared_from_this<MCTSNode<Params, State, StateInit, ValueInit, ActionValue, DefaultPolicy, Action, SelectionPolicy, OutcomeSelection>> {
+    template <typename Params, typename State, typename StateInit, typename ValueInit, typename ActionValue, typename DefaultPolicy, typename Action, typename SelectionPolicy, typename OutcomeSelection, typename Storage = HeapStorage, typename LeafValue = NoLeafValue>
+    class MCTSNode : public std::enable_shared_from_this<MCTSNode<Params, State, StateInit, ValueInit, ActionValue, DefaultPolicy, Action, SelectionPolicy, OutcomeSelection, Storage, LeafValue>> {
     public:
-        using node_type = MCTSNode<Params, State, StateInit, ValueInit, ActionValue, DefaultPolicy, Action, SelectionPolicy, OutcomeSelection>;
+        using node_type = MCTSNode<Params, State, StateInit, ValueInit, ActionValue, DefaultPolicy, Action, SelectionPolicy, OutcomeSelection, Storage, LeafValue>;
         using action_type = MCTSAction<Params, node_type, OutcomeSelection, Action>;
         using action_ptr = std::shared_ptr<action_type>;
         using node_ptr = std::shared_ptr<node_type>;
         using state_ptr = std::shared_ptr<State>;
+        using state_type = State;
+        using context_type = TreeContext<State>;
+        using table_type = TranspositionTable<State>;
 
-        MCTSNode(size_t rollout_depth = 1000, double gamma = 0.9) : _gamma(gamma), _visits(0), _rollout_depth(rollout_depth)
+        MCTSNode(size_t rollout_depth = 1000, double gamma = 0.9) : _parent(nullptr), _context(std::make_shared<context_type>(rollout_depth, gamma)), _visits(0)
         {
             _state = StateInit()();
         }
 
-        MCTSNode(State state, size_t rollout_depth = 1000, double gamma = 0.9) : _gamma(gamma), _visits(0), _rollout_depth(rollout_depth)
+        MCTSNode(State state, size_t rollout_depth = 1000, double gamma = 0.9) : _parent(nullptr), _context(std::make_shared<context_type>(rollout_depth, gamma)), _visits(0)
         {
             _state = std::make_shared<State>(state);
         }
 
-        action_ptr parent() const
+        // used by make_node(): the node (and its state) are allocated from the storage of the tree
+        MCTSNode(const Storage& storage, const State& state, const std::shared_ptr<context_type>& context) : _parent(nullptr), _context(context), _visits(0), _storage(storage)
+        {
+            _state = _storage.template make<State>(state);
+        }
+
+        action_type* parent() const
         {
             return _parent;
         }
 
-        action_ptr& parent()
+        action_type*& parent()
         {
             return _parent;
         }
 
-        std::vector<action_ptr> children() const
+        const std::vector<action_ptr>& children() const
         {
             return _children;
         }
@@ -126,87 +192,339 @@ namespace mcts {
 
         size_t visits() const
         {
-            return _visits;
+            return _visits.load(std::memory_order_relaxed);
         }
 
-        size_t& visits()
+        size_t rollout_depth() const
         {
-            return _visits;
+            return _context->rollout_depth;
         }
 
-        size_t rollout_depth() const
+        double gamma() const
         {
-            return _rollout_depth;
+            return _context->gamma;
         }
 
-        double gamma() const
+        /// child action equal to `action` (nullptr if there is none)
+        action_ptr find_child(const Action& action)
         {
-            return _gamma;
+            return _children_index.find(_children, action, [](const action_ptr& p) -> const Action& { return p->action(); });
         }
 
-        template <typename RewardFunc>
-        void compute(RewardFunc rfun, size_t iterations)
+        /// create a new (parentless) node that shares the storage of this tree
+        node_ptr make_node(const State& state)
+        {
+            return _storage.template make<node_type>(_storage, state, _context);
+        }
+
+        /// create a new action of this node (it is not added to the children)
+        action_ptr make_action(const Action& action)
+        {
+            return _storage.template make<action_type>(action, this);
+        }
+
+        /// value estimates shared with other trees (e.g. the parallel roots) and used instead of
+        /// rollouts for known leaves; needs State::hash(), nullptr (default) disables it
+        void set_transposition_table(const std::shared_ptr<table_type>& table)
+        {
+            // the context may be shared with other trees (e.g. the tree this one was rerooted from)
+            _context = std::make_shared<context_type>(*_context);
+            _context->table = table;
+        }
+
+        const std::shared_ptr<table_type>& transposition_table() const
+        {
+            return _context->table;
+        }
+
+        const std::vector<stat_type>& child_values() const
+        {
+            return _child_values;
+        }
+
+        /// counters of the searches run from this node and shape of its subtree (all 0 unless
+        /// compiled with -DMCTS_STATS); the shape is a walk of the tree, do not call it during a search
+        SearchStats stats() const
+        {
+            SearchStats stats;
+#ifdef MCTS_STATS
+            stats = _stats;
+            _shape(stats, 0);
+#endif
+            return stats;
+        }
+
+        const std::vector<visit_type>& child_visits() const
+        {
+            return _child_visits;
+        }
+
+        /// run (at most) `iterations` iterations per root; the stopping criterion `stop(node, k)` is checked
+        /// after every iteration (k: iterations of the tree so far) and can end the search of a tree early
+        /// (see VisitShareStop/ConfidenceStop). Returns the number of iterations done (summed over the roots).
+        /// With parallel roots, the first root searches this node itself (and the subtree it kept from the
+        /// previous step, see reroot()); the other roots grow new trees that are merged into it at the end.
+        /// With TBB, the parallel roots share their iterations (see par::Budget): a root slowed down by long
+        /// rollouts does fewer of them and the other roots more, so that no thread waits for it.
+        template <typename RewardFunc, typename StopCriterion = NeverStop>
+        size_t compute(RewardFunc rfun, size_t iterations, StopCriterion stop = StopCriterion())
         {
             if (Params::mcts_node::parallel_roots() > 1) {
-                par::vector<node_ptr> roots;
-                par::replicate(Params::mcts_node::parallel_roots(), [&]() {
-                  node_ptr to_ret = std::make_shared<node_type>(*this->_state, this->_rollout_depth, this->_gamma);
-                  for (size_t k = 0; k < iterations; ++k) {
+                // one random stream per root (drawn here), so that runs only depend on the global seed
+                std::vector<uint64_t> seeds = _split_seeds(Params::mcts_node::parallel_roots());
+                std::vector<node_ptr> roots(seeds.size());
+                std::atomic<size_t> done(0);
+                par::Budget budget(iterations, seeds.size());
+                par::loop(0, seeds.size(), [&](size_t i) {
+                  // the worker (often the calling thread) gets its own stream back with the root
+                  rng::ScopedStream stream(seeds[i]);
+                  // the first root is this node (with the subtree kept by reroot()); the others are new trees
+                  // with their own storage (arenas are not shared between threads)
+                  node_ptr to_ret = (i == 0) ? this->shared_from_this() : _make_root();
+                  // every root checks its own tree (with its own copy of the criterion)
+                  StopCriterion root_stop = stop;
+                  size_t k = 0;
+                  while (budget.take(k)) {
                       to_ret->iterate(rfun);
+                      k++;
+                      if (root_stop(*to_ret, k))
+                          break;
                   }
 
-                  roots.push_back(to_ret);
+                  done.fetch_add(k, std::memory_order_relaxed);
+                  // a root started once the budget was spent has nothing to merge
+                  if (k > 0)
+                      roots[i] = to_ret;
                 });
 
-                node_ptr cur_node = this->shared_from_this();
-                for (size_t i = 0; i < roots.size(); i++) {
-                    cur_node->merge_inplace(roots[i]);
+                StatsRecorder recorder;
+                size_t merged = 0;
+                for (size_t i = 1; i < roots.size(); i++) {
+                    if (!roots[i])
+                        continue;
+                    this->merge_inplace(roots[i]);
+                    merged++;
                 }
+                recorder.lap(&SearchStats::merge_ns);
+                recorder.count(&SearchStats::merges, merged);
+                _record(recorder);
+
+                return done;
             }
-            else {
-                for (size_t k = 0; k < iterations; ++k) {
-                    this->iterate(rfun);
+
+            size_t k = 0;
+            while (k < iterations) {
+                this->iterate(rfun);
+                k++;
+                if (stop(*this, k))
+                    break;
+            }
+
+            return k;
+        }
+
+        /// anytime variant: iterate until the deadline (at least once per root) or the stopping criterion
+        /// and return the number of iterations done (summed over the parallel roots)
+        template <typename RewardFunc, typename Clock, typename Duration, typename StopCriterion = NeverStop>
+        size_t compute(RewardFunc rfun, const std::chrono::time_point<Clock, Duration>& deadline, StopCriterion stop = StopCriterion())
+        {
+            if (Params::mcts_node::parallel_roots() > 1) {
+                std::vector<uint64_t> seeds = _split_seeds(Params::mcts_node::parallel_roots());
+                std::vector<node_ptr> roots(seeds.size());
+                std::atomic<size_t> iterations(0);
+                par::loop(0, seeds.size(), [&](size_t i) {
+                  // the worker (often the calling thread) gets its own stream back with the root
+                  rng::ScopedStream stream(seeds[i]);
+                  node_ptr to_ret = (i == 0) ? this->shared_from_this() : _make_root();
+                  StopCriterion root_stop = stop;
+                  size_t k = 0;
+                  do {
+                      to_ret->iterate(rfun);
+                      k++;
+                  } while (!root_stop(*to_ret, k) && Clock::now() < deadline);
+
+                  iterations.fetch_add(k, std::memory_order_relaxed);
+                  roots[i] = to_ret;
+                });
+
+                StatsRecorder recorder;
+                for (size_t i = 1; i < roots.size(); i++) {
+                    this->merge_inplace(roots[i]);
                 }
+                recorder.lap(&SearchStats::merge_ns);
+                recorder.count(&SearchStats::merges, roots.size() - 1);
+                _record(recorder);
+
+                return iterations;
+            }
+
+            size_t k = 0;
+            do {
+                this->iterate(rfun);
+                k++;
+            } while (!stop(*this, k) && Clock::now() < deadline);
+
+            return k;
+        }
+
+        /// grow this tree with several threads at once (tree parallelization);
+        /// rfun, the states and the policies must be thread-safe
+        template <typename RewardFunc>
+        void compute_tree_parallel(RewardFunc rfun, size_t iterations)
+        {
+            if (iterations == 0)
+                return;
+            // the first iteration expands the root (and sets up its storage) before the threads share it
+            this->iterate(rfun);
+            typename Storage::SharedScope shared;
+            par::loop(1, iterations, [&](size_t) {
+                this->iterate_shared(rfun);
+            });
+        }
+
+        /// batched search: every round descends `batch` times (with virtual losses, as compute_tree_parallel(),
+        /// so that the descents reach different leaves), runs the rollouts of these leaves in lockstep and backs
+        /// them up. At every rollout step, the transitions come from State::move_batch(states, actions) and the
+        /// rewards from rfun(states, actions, next_states) when they exist (static, and returning a std::vector
+        /// of the next states / of the rewards), so that e.g. a GP model is queried for all the leaves at once.
+        /// Single-threaded; returns the number of iterations done.
+        template <typename RewardFunc>
+        size_t compute_batched(RewardFunc rfun, size_t iterations, size_t batch)
+        {
+            if (iterations == 0)
+                return 0;
+            batch = std::max(batch, size_t(1));
+            // the first iteration expands the root, as in compute_tree_parallel()
+            this->iterate(rfun);
+            size_t k = 1;
+            while (k < iterations) {
+                size_t n = std::min(batch, iterations - k);
+                _iterate_batch(rfun, n);
+                k += n;
             }
+
+            return k;
         }
 
         template <typename RewardFunc>
         void iterate(RewardFunc rfun)
         {
-            std::vector<node_ptr> visited;
-            std::vector<double> rewards;
+            // plain pointers: the tree owns every node of the path for the whole iteration
+            _Path own;
+            _PathScope scope(own);
+            auto& visited = scope.path.visited;
+            auto& rewards = scope.path.rewards;
 
-            node_ptr cur_node = this->shared_from_this();
+            node_type* cur_node = this;
             visited.push_back(cur_node);
             rewards.push_back(0.0);
+            StatsRecorder recorder;
             // std::cout << "Iterate!" << std::endl;
 
             do {
-                node_ptr prev_node = cur_node;
+                node_type* prev_node = cur_node;
                 // std::cout << "(" << cur_node->_state->_x << ", " << cur_node->_state->_y << ")" << std::endl;
-                action_ptr next_action = cur_node->_expand();
+                action_type* next_action = cur_node->_expand();
                 // std::cout << "Selected action: " << next_action->action() << std::endl;
-                cur_node = next_action->node();
-                rewards.push_back(rfun(prev_node->_state, next_action->action(), cur_node->_state));
+                cur_node = next_action->node().get();
+                rewards.push_back(_reward(rfun, prev_node->_state, next_action->action(), cur_node->_state, 0));
                 // std::cout << "TO: (" << cur_node->_state->_x << ", " << cur_node->_state->_y << ")" << std::endl;
                 visited.push_back(cur_node);
+                // the step that reaches a new node is the expansion
+                if (cur_node->visits() > 0) {
+                    recorder.lap(&SearchStats::select_ns);
+                }
+                else {
+                    recorder.lap(&SearchStats::expand_ns);
+                    recorder.count(&SearchStats::expansions);
+                }
             } while (!cur_node->_state->terminal() && cur_node->visits() > 0);
 
             double value;
+            // a leaf already evaluated (by this tree or another one sharing the table) is not simulated again
+            bool known = _table_value(*cur_node->_state, value);
             if (cur_node->_state->terminal()) {
                 value = 0.0;
             }
-            else {
+            else if (!known) {
                 // std::cout << "Simulating: (" << cur_node->_state->_x << ", " << cur_node->_state->_y << ")" << std::endl;
-                value = cur_node->_simulate(rfun);
+                value = cur_node->_simulate(rfun, *_context, recorder);
             }
+            recorder.lap(&SearchStats::simulate_ns);
 
             for (int i = visited.size() - 1; i >= 0; i--) {
-                value = rewards[i] + _gamma * value;
-                visited[i]->_visits++;
+                if (!known || visited[i] != cur_node)
+                    _table_store(*visited[i]->_state, value);
+                value = rewards[i] + _context->gamma * value;
+                visited[i]->_visits.fetch_add(1, std::memory_order_relaxed);
                 if (visited[i]->_parent != nullptr)
                     visited[i]->_parent->update_stats(value);
             }
+            recorder.lap(&SearchStats::backprop_ns);
+            recorder.count(&SearchStats::iterations);
+            _record(recorder);
+        }
+
+        /// one iteration on a tree that other threads are growing at the same time:
+        /// the selected actions get a virtual loss until the backup, so that
+        /// concurrent iterations spread over different paths (with an ArenaStorage, the threads have to hold a
+        /// Storage::SharedScope, as compute_tree_parallel() does)
+        template <typename RewardFunc>
+        void iterate_shared(RewardFunc rfun)
+        {
+            const double loss = Params::mcts_node::virtual_loss();
+
+            _Path own;
+            _PathScope scope(own);
+            auto& visited = scope.path.visited;
+            auto& actions = scope.path.actions;
+            auto& rewards = scope.path.rewards;
+
+            node_type* cur_node = this;
+            visited.push_back(cur_node);
+            StatsRecorder recorder;
+            // nodes are counted when they are reached, so that a leaf is expanded by one thread only
+            bool expanded = cur_node->_visits.fetch_add(1, std::memory_order_relaxed) > 0;
+
+            while (expanded && !cur_node->_state->terminal()) {
+                node_type* prev_node = cur_node;
+                action_type* next_action = cur_node->_expand_shared(loss);
+                cur_node = next_action->node_locked().get();
+                rewards.push_back(_reward(rfun, prev_node->_state, next_action->action(), cur_node->_state, 0));
+                actions.push_back(next_action);
+                visited.push_back(cur_node);
+                expanded = cur_node->_visits.fetch_add(1, std::memory_order_relaxed) > 0;
+                if (expanded) {
+                    recorder.lap(&SearchStats::select_ns);
+                }
+                else {
+                    recorder.lap(&SearchStats::expand_ns);
+                    recorder.count(&SearchStats::expansions);
+                }
+            }
+
+            double value;
+            bool known = _table_value(*cur_node->_state, value);
+            if (cur_node->_state->terminal()) {
+                value = 0.0;
+            }
+            else if (!known) {
+                value = cur_node->_simulate(rfun, *_context, recorder);
+            }
+            recorder.lap(&SearchStats::simulate_ns);
+
+            if (!known)
+                _table_store(*cur_node->_state, value);
+            for (int i = actions.size() - 1; i >= 0; i--) {
+                value = rewards[i] + _context->gamma * value;
+                _table_store(*visited[i]->_state, value);
+                // give back the virtual loss; the visit was already counted at selection
+                std::lock_guard<par::SpinLock> lock(actions[i]->parent()->_lock);
+                actions[i]->update_stats(value + loss, 0);
+            }
+            recorder.lap(&SearchStats::backprop_ns);
+            recorder.count(&SearchStats::iterations);
+            _record(recorder);
         }
 
         size_t max_depth(size_t parent_depth = 0)
@@ -229,44 +547,74 @@ namespace mcts {
         }
 
         template <typename Value = GreedyValue>
-        action_ptr best_action()
+        action_ptr best_action() const
         {
             if (_state->terminal())
                 return nullptr;
-            double v = -std::numeric_limits<double>::max();
-            action_ptr best_action = nullptr;
-
-            for (auto child : _children) {
-                double d = Value()(child);
+            Value value;
+            size_t i = _argmax(value, 0);
+            return (i < _children.size()) ? _children[i] : nullptr;
+        }
 
-                if (d > v) {
-                    v = d;
-                    best_action = child;
+        /// keep the subtree of the outcome of `action` that matches the observed state (state equality, or
+        /// the find() of the outcome selection) as the new root; the rest of the tree is released with the old root.
+        /// With a storage that only frees its memory in bulk (ArenaStorage), the subtree is copied to a new
+        /// storage first, so that the old one is released as well. If that outcome was never explored, a fresh
+        /// root (with its own storage) is returned. The next compute() continues the search of the kept
+        /// subtree (in the first of the parallel roots, or with all the threads of compute_tree_parallel()).
+        node_ptr reroot(const Action& action, const State& state)
+        {
+            action_ptr child = find_child(action);
+            node_ptr node = (child) ? _find_outcome(child, state, 0) : nullptr;
+            if (node) {
+                if (!Storage::frees_nodes) {
+                    Storage storage;
+                    node = node->_copy(storage);
                 }
+                node->_parent = nullptr;
+                // plan from the observed state, not from the sampled outcome it matched
+                node->_state = node->_storage.template make<State>(state);
+                return node;
             }
 
-            return best_action;
+            Storage storage;
+            return storage.template make<node_type>(storage, state, _context);
         }
 
         node_ptr merge_with(const node_ptr& other)
         {
-            node_ptr to_ret = std::make_shared<node_type>(*this->_state, this->_rollout_depth, this->_gamma);
+            node_ptr to_ret = make_node(*this->_state);
             to_ret->merge_inplace(other);
 
             return to_ret;
         }
 
+        /// add the statistics of another tree (with the same root state) at every depth:
+        /// actions and outcomes are matched as in reroot(), the unmatched subtrees are adopted
         void merge_inplace(const node_ptr& other)
         {
-            node_ptr to_ret = this->shared_from_this();
+            _visits.fetch_add(uint32_t(other->visits()), std::memory_order_relaxed);
+#ifdef MCTS_STATS
+            _stats += other->_stats;
+#endif
+            for (const auto& child : other->_children) {
+                action_ptr same = find_child(child->action());
+                if (!same) {
+                    // adopted subtrees keep their own storage alive
+                    _add_child(child, child->value(), child->visits());
+                    continue;
+                }
 
-            for (auto child : other->_children) {
-                auto it = std::find_if(to_ret->_children.begin(), to_ret->_children.end(), [&](action_ptr const& p) { return *p == *child; });
-                if (it == to_ret->_children.end())
-                    to_ret->_children.push_back(child);
-                else {
-                    (*it)->value() += child->value();
-                    (*it)->visits() += child->visits();
+                same->update_stats(child->value(), child->visits());
+                for (const auto& node : child->children()) {
+                    node_ptr same_node = _find_outcome(same, *node->_state, 0);
+                    if (!same_node) {
+                        node->_parent = same.get();
+                        same->children().push_back(node);
+                    }
+                    else {
+                        same_node->merge_inplace(node);
+                    }
                 }
             }
         }
@@ -285,75 +633,610 @@ namespace mcts {
         // }
 
     protected:
-        action_ptr _parent;
+        action_type* _parent;
         std::vector<action_ptr> _children;
+        // statistics of the children (structure of arrays, in children order) for the selection kernels
+        std::vector<stat_type> _child_values;
+        std::vector<visit_type> _child_visits;
         state_ptr _state;
-        double _gamma;
-        size_t _visits, _rollout_depth;
+        // the searches use the context of their root
+        std::shared_ptr<context_type> _context;
+        // the small members are kept together, so that they share their padding
+        std::atomic<uint32_t> _visits;
+        par::SpinLock _lock;
+        ChildIndex<Action> _children_index;
+        CandidateActions<State, Action> _candidates;
+        Storage _storage;
+#ifdef MCTS_STATS
+        SearchStats _stats;
+        par::SpinLock _stats_lock;
+#endif
 
-        action_ptr _expand()
+        friend action_type;
+
+        action_type* _expand()
         {
             if (SelectionPolicy()(this->shared_from_this())) {
-                Action act = _state->next_action();
-                action_ptr next_action = std::make_shared<action_type>(act, this->shared_from_this(), ValueInit()(_state));
-                auto it = std::find_if(_children.begin(), _children.end(), [&](action_ptr const& p) { return *p == *next_action; });
-                if (_children.size() == 0 || it == _children.end()) {
-                    _children.push_back(next_action);
-                    return next_action;
-                }
+                Action act = _next_action(std::integral_constant<bool, has_candidate_actions<State>::value>());
+                action_ptr child = find_child(act);
+                if (!child)
+                    return _add_child(make_action(act), ValueInit()(_state), 0);
 
-                return (*it);
+                return child.get();
             }
 
             return _select_action();
         }
 
-        action_ptr _select_action()
+        // copy of this subtree (states, statistics and untried candidates) allocated from `storage`
+        node_ptr _copy(Storage& storage) const
+        {
+            node_ptr node = storage.template make<node_type>(storage, *_state, _context);
+            node->_visits = uint32_t(visits());
+            node->_child_values = _child_values;
+            node->_child_visits = _child_visits;
+            node->_candidates = _candidates;
+#ifdef MCTS_STATS
+            node->_stats = _stats;
+#endif
+            node->_children.reserve(_children.size());
+            for (const auto& child : _children) {
+                action_ptr action = storage.template make<action_type>(child->action(), node.get());
+                action->_index = child->_index;
+                action->_children.reserve(child->children().size());
+                for (const auto& outcome : child->children()) {
+                    node_ptr copy = outcome->_copy(storage);
+                    copy->_parent = action.get();
+                    action->_children.push_back(copy);
+                }
+                node->_children.push_back(action);
+            }
+
+            return node;
+        }
+
+        // new tree from the state of this node, with its own storage
+        node_ptr _make_root() const
+        {
+            Storage storage;
+            return storage.template make<node_type>(storage, *_state, _context);
+        }
+
+        static std::vector<uint64_t> _split_seeds(size_t n)
+        {
+            std::vector<uint64_t> seeds(n);
+            for (size_t i = 0; i < n; i++)
+                seeds[i] = rng::split();
+            return seeds;
+        }
+
+        // path of an iteration (nodes, actions of the shared trees, rewards): most paths fit inline
+        struct _Path {
+            SmallVector<node_type*, 64> visited;
+            SmallVector<action_type*, 64> actions;
+            SmallVector<double, 64> rewards;
+            bool busy = false;
+        };
+
+        static _Path& _thread_path()
+        {
+            thread_local _Path path;
+            return path;
+        }
+
+        // takes the path of the calling thread, so that its iterations do not allocate once the deepest
+        // path was seen, or `own` for a nested iteration (e.g. a search run by a rollout)
+        struct _PathScope {
+            _Path& path;
+
+            _PathScope(_Path& own) : path(_thread_path().busy ? own : _thread_path())
+            {
+                path.busy = true;
+                path.visited.clear();
+                path.actions.clear();
+                path.rewards.clear();
+            }
+
+            ~_PathScope()
+            {
+                path.busy = false;
+            }
+        };
+
+        action_type* _expand_shared(double loss)
+        {
+            std::unique_lock<par::SpinLock> lock(_lock);
+            action_type* action;
+            if (SelectionPolicy()(this->shared_from_this())) {
+                // next_action() can be expensive (e.g. a planner): keep it out of the critical section
+                Action act = _next_action(lock, std::integral_constant<bool, has_candidate_actions<State>::value>());
+                double value = ValueInit()(_state);
+                lock.lock();
+
+                action_ptr child = find_child(act);
+                action = (child) ? child.get() : _add_child(make_action(act), value, 0);
+            }
+            else {
+                action = _select_action();
+            }
+
+            // virtual loss (and visit), applied before other threads can select again
+            action->update_stats(-loss, 1);
+            return action;
+        }
+
+        // next action to widen the node with: the next candidate (see candidates.hpp) or next_action()
+        Action _next_action(std::true_type)
+        {
+            if (!_candidates.ready())
+                _candidates.fill(_candidates.compute(*_state));
+            Action act;
+            if (!_candidates.pop(act))
+                act = _state->next_action();
+            return act;
+        }
+
+        Action _next_action(std::false_type)
+        {
+            return _state->next_action();
+        }
+
+        // shared trees: called with the lock of the node held, returns with it released
+        Action _next_action(std::unique_lock<par::SpinLock>& lock, std::true_type)
+        {
+            if (!_candidates.ready()) {
+                lock.unlock();
+                std::vector<Action> candidates = _candidates.compute(*_state);
+                lock.lock();
+                if (!_candidates.ready())
+                    _candidates.fill(std::move(candidates));
+            }
+
+            Action act;
+            bool found = _candidates.pop(act);
+            lock.unlock();
+            if (!found)
+                act = _state->next_action();
+            return act;
+        }
+
+        Action _next_action(std::unique_lock<par::SpinLock>& lock, std::false_type)
+        {
+            lock.unlock();
+            return _state->next_action();
+        }
+
+        action_type* _select_action()
         {
             if (_state->terminal())
                 return nullptr;
+            ActionValue value;
+            size_t i = _argmax(value, 0);
+            return (i < _children.size()) ? _children[i].get() : nullptr;
+        }
+
+        // outcome policies with a find(action, state) method match the outcomes themselves (e.g. open loop);
+        // otherwise the outcome is the child with an equal state
+        template <typename Outcome = OutcomeSelection>
+        static auto _find_outcome(const action_ptr& action, const State& state, int) -> decltype(Outcome().find(action, state))
+        {
+            return Outcome().find(action, state);
+        }
+
+        template <typename Outcome = OutcomeSelection>
+        static node_ptr _find_outcome(const action_ptr& action, const State& state, long)
+        {
+            return action->find_child(state);
+        }
+
+        // value policies with an argmax(node) method score all the children at once
+        // (on the statistics arrays); the others are called child by child
+        template <typename Value>
+        auto _argmax(Value& value, int) const -> decltype(value.argmax(*this))
+        {
+            return value.argmax(*this);
+        }
+
+        template <typename Value>
+        size_t _argmax(Value& value, long) const
+        {
             double v = -std::numeric_limits<double>::max();
-            action_ptr best_action = nullptr;
+            size_t best = _children.size();
 
-            for (auto child : _children) {
-                double d = ActionValue()(child);
+            for (size_t i = 0; i < _children.size(); i++) {
+                double d = value(_children[i]);
 
                 if (d > v) {
                     v = d;
-                    best_action = child;
+                    best = i;
                 }
             }
 
-            return best_action;
+            return best;
+        }
+
+        bool _table_value(const State& state, double& value)
+        {
+            return _table_value(state, value, std::integral_constant<bool, has_hash<State>::value>());
+        }
+
+        bool _table_value(const State& state, double& value, std::true_type)
+        {
+            size_t visits;
+            return _context->table && _context->table->lookup(state, value, visits);
+        }
+
+        bool _table_value(const State&, double&, std::false_type)
+        {
+            return false;
+        }
+
+        void _table_store(const State& state, double value)
+        {
+            _table_store(state, value, std::integral_constant<bool, has_hash<State>::value>());
+        }
+
+        void _table_store(const State& state, double value, std::true_type)
+        {
+            if (_context->table)
+                _context->table->update(state, value);
+        }
+
+        void _table_store(const State&, double, std::false_type) {}
+
+        void _record(const StatsRecorder& recorder)
+        {
+#ifdef MCTS_STATS
+            std::lock_guard<par::SpinLock> lock(_stats_lock);
+            _stats += recorder.stats();
+#endif
+        }
+
+        void _shape(SearchStats& stats, size_t depth) const
+        {
+            if (stats.depth_nodes.size() <= depth) {
+                stats.depth_nodes.resize(depth + 1, 0);
+                stats.depth_actions.resize(depth + 1, 0);
+            }
+            stats.depth_nodes[depth]++;
+            stats.depth_actions[depth] += _children.size();
+            for (const auto& child : _children)
+                for (const auto& node : child->children())
+                    node->_shape(stats, depth + 1);
+        }
+
+        action_type* _add_child(const action_ptr& child, double value, size_t visits)
+        {
+            child->_parent = this;
+            child->_index = uint32_t(_children.size());
+            _children.push_back(child);
+            _child_values.push_back(stat_type(value));
+            _child_visits.push_back(visit_type(visits));
+            return child.get();
+        }
+
+        void _update_child(size_t i, double value, size_t visits)
+        {
+            _child_values[i] += value;
+            _child_visits[i] += visit_type(visits);
+        }
+
+        // `n` iterations of compute_batched(): the descents of iterate_shared(), then all the rollouts at once
+        template <typename RewardFunc>
+        void _iterate_batch(RewardFunc& rfun, size_t n)
+        {
+            const double loss = Params::mcts_node::virtual_loss();
+
+            // the paths, one after the other: the actions (and rewards) of path b start at starts[b]
+            std::vector<action_type*> actions;
+            std::vector<double> rewards;
+            std::vector<size_t> starts;
+            std::vector<node_type*> leaves;
+            std::vector<double> values(n, 0.0);
+            std::vector<bool> known(n, false);
+            // leaves to simulate (copies: open-loop outcomes re-sample the states of the nodes at every descent)
+            std::vector<State> states;
+            std::vector<size_t> simulated;
+            StatsRecorder recorder;
+
+            for (size_t b = 0; b < n; b++) {
+                starts.push_back(actions.size());
+                node_type* cur_node = this;
+                bool expanded = cur_node->_visits.fetch_add(1, std::memory_order_relaxed) > 0;
+
+                while (expanded && !cur_node->_state->terminal()) {
+                    node_type* prev_node = cur_node;
+                    action_type* next_action = cur_node->_expand_shared(loss);
+                    cur_node = next_action->node_locked().get();
+                    rewards.push_back(_reward(rfun, prev_node->_state, next_action->action(), cur_node->_state, 0));
+                    actions.push_back(next_action);
+                    expanded = cur_node->_visits.fetch_add(1, std::memory_order_relaxed) > 0;
+                    if (expanded) {
+                        recorder.lap(&SearchStats::select_ns);
+                    }
+                    else {
+                        recorder.lap(&SearchStats::expand_ns);
+                        recorder.count(&SearchStats::expansions);
+                    }
+                }
+
+                leaves.push_back(cur_node);
+                known[b] = _table_value(*cur_node->_state, values[b]);
+                if (cur_node->_state->terminal()) {
+                    values[b] = 0.0;
+                }
+                else if (!known[b]) {
+                    states.push_back(*cur_node->_state);
+                    simulated.push_back(b);
+                }
+            }
+            starts.push_back(actions.size());
+            recorder.lap(&SearchStats::select_ns);
+
+            std::vector<double> returns = _simulate_batch(rfun, states, recorder);
+            for (size_t i = 0; i < simulated.size(); i++)
+                values[simulated[i]] = returns[i];
+            recorder.lap(&SearchStats::simulate_ns);
+
+            for (size_t b = 0; b < n; b++) {
+                double value = values[b];
+                if (!known[b])
+                    _table_store(*leaves[b]->_state, value);
+                for (size_t i = starts[b + 1]; i-- > starts[b];) {
+                    value = rewards[i] + _context->gamma * value;
+                    _table_store(*actions[i]->parent()->_state, value);
+                    // give back the virtual loss; the visit was already counted at selection
+                    std::lock_guard<par::SpinLock> lock(actions[i]->parent()->_lock);
+                    actions[i]->update_stats(value + loss, 0);
+                }
+            }
+            recorder.lap(&SearchStats::backprop_ns);
+            recorder.count(&SearchStats::iterations, n);
+            _record(recorder);
+        }
+
+        // rollouts of several states in lockstep (same returns as _simulate() on each of them)
+        template <typename RewardFunc>
+        std::vector<double> _simulate_batch(RewardFunc& rfun, std::vector<State>& states, StatsRecorder& recorder)
+        {
+            std::vector<double> returns(states.size(), 0.0);
+            std::vector<double> discounts(states.size(), 1.0);
+            // rollouts still running (indices in states)
+            std::vector<size_t> running(states.size());
+            for (size_t i = 0; i < running.size(); i++)
+                running[i] = i;
+
+            std::vector<State> from;
+            std::vector<Action> step_actions;
+            for (size_t k = 0; k < _context->rollout_depth && !running.empty(); ++k) {
+                from.clear();
+                step_actions.clear();
+                for (size_t i : running) {
+                    from.push_back(states[i]);
+                    step_actions.push_back(_default_policy(states[i], 0));
+                }
+
+                std::vector<State> to = _move_batch(from, step_actions, 0);
+                std::vector<double> step_rewards = _reward_batch(rfun, from, step_actions, to, 0);
+                size_t kept = 0;
+                for (size_t j = 0; j < running.size(); j++) {
+                    size_t i = running[j];
+                    returns[i] += discounts[i] * step_rewards[j];
+                    states[i] = std::move(to[j]);
+                    recorder.count(&SearchStats::rollout_steps);
+                    if (states[i].terminal()) {
+                        recorder.count(&SearchStats::rollouts);
+                        continue;
+                    }
+                    discounts[i] *= _context->gamma;
+                    running[kept++] = i;
+                }
+                running.resize(kept);
+            }
+
+            // truncated rollouts: the rest of the return is estimated
+            for (size_t i : running)
+                returns[i] += discounts[i] * _leaf_value(states[i], 0);
+            recorder.count(&SearchStats::rollouts, running.size());
+
+            return returns;
+        }
+
+        // batched transitions and rewards (see compute_batched()), or one call per state
+        template <typename S = State>
+        static auto _move_batch(const std::vector<State>& states, const std::vector<Action>& actions, int) -> typename std::enable_if<std::is_same<decltype(S::move_batch(states, actions)), std::vector<State>>::value, std::vector<State>>::type
+        {
+            return S::move_batch(states, actions);
+        }
+
+        template <typename S = State>
+        static std::vector<State> _move_batch(const std::vector<State>& states, const std::vector<Action>& actions, long)
+        {
+            std::vector<State> next;
+            next.reserve(states.size());
+            for (size_t i = 0; i < states.size(); i++)
+                next.push_back(states[i].move(actions[i]));
+            return next;
+        }
+
+        template <typename RewardFunc>
+        static auto _reward_batch(RewardFunc& rfun, const std::vector<State>& from, const std::vector<Action>& actions, const std::vector<State>& to, int) -> typename std::enable_if<std::is_same<decltype(rfun(from, actions, to)), std::vector<double>>::value, std::vector<double>>::type
+        {
+            return rfun(from, actions, to);
+        }
+
+        template <typename RewardFunc>
+        static std::vector<double> _reward_batch(RewardFunc& rfun, const std::vector<State>& from, const std::vector<Action>& actions, const std::vector<State>& to, long)
+        {
+            std::vector<double> rewards(from.size());
+            for (size_t i = 0; i < from.size(); i++)
+                rewards[i] = _reward(rfun, from[i], actions[i], to[i], 0);
+            return rewards;
+        }
+
+        // rollout from this node with the parameters of the tree that runs the search: the states are kept by
+        // value when the functors take them by reference, and allocated at every step (as before) otherwise
+        template <typename RewardFunc>
+        double _simulate(RewardFunc rfun, const context_type& context, StatsRecorder& recorder)
+        {
+            return _simulate(rfun, context.rollout_depth, context.gamma, recorder, std::integral_constant<bool, decltype(_by_reference(rfun, 0))::value && std::is_move_constructible<State>::value && std::is_move_assignable<State>::value>());
+        }
+
+        // rollout with the states kept by value: no allocation per step
+        template <typename RewardFunc>
+        double _simulate(RewardFunc& rfun, size_t rollout_depth, double gamma, StatsRecorder& recorder, std::true_type)
+        {
+            double discount = 1.0;
+            double reward = 0.0;
+
+            State prev_state = *_state;
+            State cur_state = prev_state;
+
+            size_t k = 0;
+            for (; k < rollout_depth; ++k) {
+                // Choose action according to default policy
+                Action action = _default_policy(cur_state, 0);
+                prev_state = std::move(cur_state);
+
+                // Update state
+                cur_state = prev_state.move(action);
+                recorder.count(&SearchStats::rollout_steps);
+
+                // Get value from (PO)MDP
+                reward += discount * _reward(rfun, prev_state, action, cur_state, 0);
+
+                // Check if terminal state
+                if (cur_state.terminal())
+                    break;
+                discount *= gamma;
+            }
+
+            recorder.count(&SearchStats::rollouts);
+            // truncated rollout: the rest of the return is estimated
+            if (k == rollout_depth)
+                reward += discount * _leaf_value(cur_state, 0);
+
+            return reward;
         }
 
+        // shared_ptr functors (or states that cannot be re-assigned, e.g. with const members): the states are
+        // allocated at every step and the functors get the pointers of the rollout
         template <typename RewardFunc>
-        double _simulate(RewardFunc rfun)
+        double _simulate(RewardFunc& rfun, size_t rollout_depth, double gamma, StatsRecorder& recorder, std::false_type)
         {
             double discount = 1.0;
             double reward = 0.0;
 
             state_ptr cur_state = _state;
 
-            for (size_t k = 0; k < _rollout_depth; ++k) {
+            size_t k = 0;
+            for (; k < rollout_depth; ++k) {
                 // Choose action according to default policy
-                Action action = DefaultPolicy()(cur_state);
+                Action action = _default_policy(cur_state, 0);
                 state_ptr prev_state = cur_state;
 
                 // Update state
                 cur_state = std::make_shared<State>(cur_state->move(action));
+                recorder.count(&SearchStats::rollout_steps);
 
                 // Get value from (PO)MDP
-                reward += discount * rfun(prev_state, action, cur_state);
+                reward += discount * _reward(rfun, prev_state, action, cur_state, 0);
 
                 // Check if terminal state
                 if (cur_state->terminal())
                     break;
-                discount *= _gamma;
+                discount *= gamma;
             }
 
+            recorder.count(&SearchStats::rollouts);
+            // truncated rollout: the rest of the return is estimated
+            if (k == rollout_depth)
+                reward += discount * _leaf_value(cur_state, 0);
+
             return reward;
         }
+
+        // reward functions, default policies and leaf values can take the states by reference (preferred) or
+        // as shared_ptr (the interface of the policies of older versions). The states of the nodes and of the
+        // shared_ptr rollouts are passed as they are; the states kept by value (rollouts of _simulate_batch())
+        // are copied to new shared_ptr for the functors that only take shared_ptr, so that they can keep them.
+        template <typename RewardFunc, typename Policy = DefaultPolicy, typename Estimator = LeafValue>
+        static auto _by_reference(RewardFunc& rfun, int) -> decltype(void(rfun(std::declval<const State&>(), std::declval<const Action&>(), std::declval<const State&>())), void(Policy()(std::declval<const State&>())), void(Estimator()(std::declval<const State&>())), std::true_type());
+
+        template <typename RewardFunc>
+        static std::false_type _by_reference(RewardFunc&, long);
+
+        template <typename RewardFunc>
+        static auto _reward(RewardFunc& rfun, const State& from, const Action& action, const State& to, int) -> decltype(rfun(from, action, to))
+        {
+            return rfun(from, action, to);
+        }
+
+        template <typename RewardFunc>
+        static double _reward(RewardFunc& rfun, const State& from, const Action& action, const State& to, long)
+        {
+            return rfun(std::make_shared<State>(from), action, std::make_shared<State>(to));
+        }
+
+        template <typename RewardFunc>
+        static auto _reward(RewardFunc& rfun, const state_ptr& from, const Action& action, const state_ptr& to, int) -> decltype(rfun(*from, action, *to))
+        {
+            return rfun(*from, action, *to);
+        }
+
+        template <typename RewardFunc>
+        static double _reward(RewardFunc& rfun, const state_ptr& from, const Action& action, const state_ptr& to, long)
+        {
+            return rfun(from, action, to);
+        }
+
+        template <typename Policy = DefaultPolicy>
+        static auto _default_policy(const State& state, int) -> decltype(Policy()(state))
+        {
+            return Policy()(state);
+        }
+
+        template <typename Policy = DefaultPolicy>
+        static Action _default_policy(const State& state, long)
+        {
+            return Policy()(std::make_shared<State>(state));
+        }
+
+        template <typename Policy = DefaultPolicy>
+        static auto _default_policy(const state_ptr& state, int) -> decltype(Policy()(*state))
+        {
+            return Policy()(*state);
+        }
+
+        template <typename Policy = DefaultPolicy>
+        static Action _default_policy(const state_ptr& state, long)
+        {
+            return Policy()(state);
+        }
+
+        template <typename Estimator = LeafValue>
+        static auto _leaf_value(const State& state, int) -> decltype(double(Estimator()(state)))
+        {
+            return Estimator()(state);
+        }
+
+        template <typename Estimator = LeafValue>
+        static double _leaf_value(const State& state, long)
+        {
+            return Estimator()(std::make_shared<State>(state));
+        }
+
+        template <typename Estimator = LeafValue>
+        static auto _leaf_value(const state_ptr& state, int) -> decltype(double(Estimator()(*state)))
+        {
+            return Estimator()(*state);
+        }
+
+        template <typename Estimator = LeafValue>
+        static double _leaf_value(const state_ptr& state, long)
+        {
+            return Estimator()(state);
+        }
     };
 }
 
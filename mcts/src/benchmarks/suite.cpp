@@ -0,0 +1,492 @@
+// Benchmark suite: every domain (grid world, trap, toy continuous), serial and with parallel roots
+// (and open-loop variants of the continuous domains, and *_arena variants with mcts::ArenaStorage instead
+// of the default mcts::HeapStorage).
+// Usage: suite [--csv|--json] [--seed N] [filter]   (filter: substring of the case names, e.g. "trap")
+// Peak memory is the peak of the process so far: run one case (filter) to get its own peak.
+// The *_reroot cases run a planning loop that reuses the tree (MCTSNode::reroot()) and fail (exit status 1)
+// when the live heap memory keeps growing from one step to the next.
+#include <iostream>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <mcts/uct.hpp>
+
+// live heap memory of the process: every allocation goes through these operators and keeps its size
+namespace memory {
+    std::atomic<long> live_bytes(0);
+    const size_t header = alignof(std::max_align_t);
+
+    long live_kb()
+    {
+        return live_bytes.load() / 1024;
+    }
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    char* p = static_cast<char*>(std::malloc(size + memory::header));
+    if (p == nullptr)
+        return nullptr;
+    *reinterpret_cast<size_t*>(p) = size;
+    memory::live_bytes += long(size);
+    return p + memory::header;
+}
+
+void* operator new(size_t size)
+{
+    void* p = operator new(size, std::nothrow);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    if (ptr == nullptr)
+        return;
+    char* p = static_cast<char*>(ptr) - memory::header;
+    memory::live_bytes -= long(*reinterpret_cast<size_t*>(p));
+    std::free(p);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    operator delete(ptr);
+}
+
+struct Params {
+    struct uct {
+        MCTS_DYN_PARAM(double, c);
+    };
+
+    struct spw {
+        MCTS_PARAM(double, a, 0.5);
+    };
+
+    struct cont_outcome {
+        MCTS_PARAM(double, b, 0.6);
+    };
+
+    struct mcts_node {
+        MCTS_DYN_PARAM(size_t, parallel_roots);
+        MCTS_PARAM(double, virtual_loss, 100.0);
+    };
+};
+
+// discrete, stochastic (same as uct.cpp)
+namespace grid {
+    const size_t N = 10;
+    const double prob = 0.1;
+
+    struct GridState {
+        size_t _x, _y;
+
+        GridState() : _x(0), _y(0) {}
+        GridState(size_t x, size_t y) : _x(x), _y(y) {}
+
+        bool valid(size_t action) const
+        {
+            if (action == 0)
+                return _y + 1 < N;
+            if (action == 1)
+                return _y > 0;
+            if (action == 2)
+                return _x + 1 < N;
+            return _x > 0;
+        }
+
+        size_t next_action() const
+        {
+            return random_action();
+        }
+
+        size_t random_action() const
+        {
+            size_t act;
+            do {
+                act = mcts::rng::uniform_int<size_t>(0, 3);
+            } while (!valid(act));
+
+            return act;
+        }
+
+        GridState move(size_t action) const
+        {
+            if (mcts::rng::uniform() < prob)
+                action = (action + 1) % 4;
+            if (!valid(action))
+                return *this;
+            if (action == 0)
+                return GridState(_x, _y + 1);
+            if (action == 1)
+                return GridState(_x, _y - 1);
+            if (action == 2)
+                return GridState(_x + 1, _y);
+            return GridState(_x - 1, _y);
+        }
+
+        bool terminal() const
+        {
+            return _x == N - 1 && _y == N - 1;
+        }
+
+        bool operator==(const GridState& other) const
+        {
+            return _x == other._x && _y == other._y;
+        }
+
+        size_t hash() const
+        {
+            return _y * N + _x;
+        }
+    };
+
+    struct RewardFunction {
+        double operator()(const GridState& from_state, size_t action, const GridState& to_state)
+        {
+            return to_state.terminal() ? 1.0 : 0.0;
+        }
+    };
+
+    using tree_type = mcts::MCTSNode<Params, GridState, mcts::SimpleStateInit<GridState>, mcts::SimpleValueInit, mcts::UCTValue<Params>, mcts::UniformRandomPolicy<GridState, size_t>, size_t, mcts::SimpleSelectPolicy, mcts::SimpleOutcomeSelect>;
+    using arena_type = mcts::MCTSNode<Params, GridState, mcts::SimpleStateInit<GridState>, mcts::SimpleValueInit, mcts::UCTValue<Params>, mcts::UniformRandomPolicy<GridState, size_t>, size_t, mcts::SimpleSelectPolicy, mcts::SimpleOutcomeSelect, mcts::ArenaStorage>;
+}
+
+// continuous actions, two steps (same as benchmarks/trap.cpp)
+namespace trap {
+    const double a = 70;
+    const double h = 100;
+    const double l = 1;
+    const double w = 0.7;
+
+    struct TrapState {
+        double _x;
+        int _time;
+        static constexpr double _epsilon = 1e-6;
+
+        TrapState() : _x(0), _time(0) {}
+        TrapState(double x, int t) : _x(x), _time(t) {}
+
+        double next_action() const
+        {
+            return random_action();
+        }
+
+        double random_action() const
+        {
+            return mcts::rng::uniform();
+        }
+
+        TrapState move(double d) const
+        {
+            return TrapState(_x + d + 0.01 * mcts::rng::uniform(), _time + 1);
+        }
+
+        bool terminal() const
+        {
+            return _time >= 2;
+        }
+
+        bool operator==(const TrapState& other) const
+        {
+            double dx = _x - other._x;
+            return (dx * dx) < _epsilon;
+        }
+
+        // cells of the size of the equality tolerance: an equal state is in the same cell or in a neighbouring one
+        size_t hash() const
+        {
+            return std::hash<long>()(_cell());
+        }
+
+        std::array<size_t, 3> hash_cells() const
+        {
+            long c = _cell();
+            return {{std::hash<long>()(c - 1), std::hash<long>()(c), std::hash<long>()(c + 1)}};
+        }
+
+        long _cell() const
+        {
+            return static_cast<long>(std::floor(_x / std::sqrt(_epsilon)));
+        }
+    };
+
+    struct RewardFunction {
+        double operator()(const TrapState& from_state, double action, const TrapState& to_state)
+        {
+            if (to_state._x < l)
+                return a;
+            if (to_state._x < l + w)
+                return 0.0;
+            return h;
+        }
+    };
+
+    using tree_type = mcts::MCTSNode<Params, TrapState, mcts::SimpleStateInit<TrapState>, mcts::SimpleValueInit, mcts::UCTValue<Params>, mcts::UniformRandomPolicy<TrapState, double>, double, mcts::SPWSelectPolicy<Params>, mcts::ContinuousOutcomeSelect<Params>>;
+    using open_loop_type = mcts::MCTSNode<Params, TrapState, mcts::SimpleStateInit<TrapState>, mcts::SimpleValueInit, mcts::UCTValue<Params>, mcts::UniformRandomPolicy<TrapState, double>, double, mcts::SPWSelectPolicy<Params>, mcts::OpenLoopOutcomeSelect>;
+    using arena_type = mcts::MCTSNode<Params, TrapState, mcts::SimpleStateInit<TrapState>, mcts::SimpleValueInit, mcts::UCTValue<Params>, mcts::UniformRandomPolicy<TrapState, double>, double, mcts::SPWSelectPolicy<Params>, mcts::ContinuousOutcomeSelect<Params>, mcts::ArenaStorage>;
+}
+
+// continuous 2D navigation with long rollouts (same as toy_sim.cpp)
+namespace toy {
+    const double goal_x = 2.0;
+    const double goal_y = 2.0;
+
+    struct ToyState {
+        double _x, _y;
+        static constexpr double _epsilon = 1e-6;
+
+        ToyState() : _x(0), _y(0) {}
+        ToyState(double x, double y) : _x(x), _y(y) {}
+
+        double next_action() const
+        {
+            double th = mcts::rng::gaussian(std::atan2(goal_y - _y, goal_x - _x), 0.3);
+            if (th > M_PI)
+                th -= 2 * M_PI;
+            if (th < -M_PI)
+                th += 2 * M_PI;
+            return th;
+        }
+
+        double random_action() const
+        {
+            return mcts::rng::uniform(-M_PI, M_PI);
+        }
+
+        ToyState move(double theta) const
+        {
+            if (mcts::rng::uniform() < 0.2)
+                theta += 0.1;
+            return ToyState(_x + 0.1 * std::cos(theta), _y + 0.1 * std::sin(theta));
+        }
+
+        bool terminal() const
+        {
+            double dx = _x - goal_x;
+            double dy = _y - goal_y;
+            return (dx * dx + dy * dy) < 0.01;
+        }
+
+        bool operator==(const ToyState& other) const
+        {
+            double dx = _x - other._x;
+            double dy = _y - other._y;
+            return (dx * dx + dy * dy) < _epsilon;
+        }
+    };
+
+    struct RewardFunction {
+        double operator()(const ToyState& from_state, double action, const ToyState& to_state)
+        {
+            return to_state.terminal() ? 10.0 : -1.0;
+        }
+    };
+
+    using tree_type = mcts::MCTSNode<Params, ToyState, mcts::SimpleStateInit<ToyState>, mcts::SimpleValueInit, mcts::UCTValue<Params>, mcts::UniformRandomPolicy<ToyState, double>, double, mcts::SPWSelectPolicy<Params>, mcts::ContinuousOutcomeSelect<Params>>;
+    using open_loop_type = mcts::MCTSNode<Params, ToyState, mcts::SimpleStateInit<ToyState>, mcts::SimpleValueInit, mcts::UCTValue<Params>, mcts::UniformRandomPolicy<ToyState, double>, double, mcts::SPWSelectPolicy<Params>, mcts::OpenLoopOutcomeSelect>;
+    using arena_type = mcts::MCTSNode<Params, ToyState, mcts::SimpleStateInit<ToyState>, mcts::SimpleValueInit, mcts::UCTValue<Params>, mcts::UniformRandomPolicy<ToyState, double>, double, mcts::SPWSelectPolicy<Params>, mcts::ContinuousOutcomeSelect<Params>, mcts::ArenaStorage>;
+}
+
+struct Result {
+    std::string name;
+    size_t roots;
+    size_t iterations;
+    double seconds;
+    mcts::SearchStats stats;
+    size_t nodes;
+    long peak_rss_kb;
+    // live heap memory at the end (for the *_reroot cases: the most after a step)
+    long live_kb;
+};
+
+template <typename Node>
+size_t count_nodes(const Node& node)
+{
+    size_t n = 1;
+    for (const auto& action : node.children())
+        for (const auto& child : action->children())
+            n += count_nodes(*child);
+    return n;
+}
+
+template <typename Tree, typename RewardFunc>
+Result run(const std::string& name, double c, size_t roots, size_t iterations, size_t rollout_depth, double gamma, RewardFunc rfun)
+{
+    Params::uct::set_c(c);
+    Params::mcts_node::set_parallel_roots(roots);
+
+    auto tree = std::make_shared<Tree>(typename Tree::state_type(), rollout_depth, gamma);
+
+    auto t1 = std::chrono::steady_clock::now();
+    tree->compute(rfun, iterations);
+    auto t2 = std::chrono::steady_clock::now();
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    Result r;
+    r.name = name;
+    r.roots = roots;
+    // compute() runs the iterations on every root
+    r.iterations = iterations * roots;
+    r.seconds = std::chrono::duration<double>(t2 - t1).count();
+    r.stats = tree->stats();
+    r.nodes = count_nodes(*tree);
+    r.peak_rss_kb = usage.ru_maxrss;
+    r.live_kb = memory::live_kb();
+    return r;
+}
+
+// planning loop with tree reuse: `steps` searches of `iterations` iterations, each followed by the best action
+// (with a sampled outcome) and a reroot() at the reached state. The memory is `bounded` when the live heap
+// memory after the last step is at most twice the one after the first quarter of the steps: the old trees
+// have to be released, whatever the storage. With parallel roots, the first root searches the kept tree and
+// the others are merged into it.
+template <typename Tree, typename RewardFunc>
+Result run_reroot(const std::string& name, double c, size_t roots, size_t steps, size_t iterations, size_t rollout_depth, double gamma, RewardFunc rfun, bool& bounded)
+{
+    Params::uct::set_c(c);
+    Params::mcts_node::set_parallel_roots(roots);
+
+    using State = typename Tree::state_type;
+    long before = memory::live_kb();
+    auto tree = std::make_shared<Tree>(State(), rollout_depth, gamma);
+    std::vector<long> live;
+    mcts::SearchStats stats;
+
+    auto t1 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < steps && !tree->state()->terminal(); i++) {
+        tree->compute(rfun, iterations);
+        stats += tree->stats();
+        // a copy: a handle to the action would keep the old tree alive
+        auto action = tree->best_action()->action();
+        State next = tree->state()->move(action);
+        tree = tree->reroot(action, next);
+        live.push_back(memory::live_kb() - before);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    bounded = live.empty() || live.back() <= 2 * live[live.size() / 4];
+    if (!bounded) {
+        std::cerr << name << ": the live memory keeps growing (kB after each step):";
+        for (long kb : live)
+            std::cerr << " " << kb;
+        std::cerr << std::endl;
+    }
+
+    Result r;
+    r.name = name;
+    r.roots = roots;
+    r.iterations = iterations * roots * live.size();
+    r.seconds = std::chrono::duration<double>(t2 - t1).count();
+    r.stats = stats;
+    r.nodes = count_nodes(*tree);
+    r.peak_rss_kb = usage.ru_maxrss;
+    r.live_kb = live.empty() ? 0 : *std::max_element(live.begin(), live.end());
+    return r;
+}
+
+double per_iteration(uint64_t ns, const Result& r)
+{
+    return (r.stats.iterations > 0) ? double(ns) / double(r.stats.iterations) : 0.0;
+}
+
+void print_csv(const std::vector<Result>& results)
+{
+    std::cout << "name,roots,iterations,seconds,iterations_per_second,select_ns,expand_ns,simulate_ns,backprop_ns,merge_ns,nodes,depth,mean_rollout_length,peak_rss_kb,live_kb" << std::endl;
+    for (const auto& r : results) {
+        std::cout << r.name << "," << r.roots << "," << r.iterations << "," << r.seconds << "," << r.iterations / r.seconds << ","
+                  << per_iteration(r.stats.select_ns, r) << "," << per_iteration(r.stats.expand_ns, r) << "," << per_iteration(r.stats.simulate_ns, r) << "," << per_iteration(r.stats.backprop_ns, r) << "," << r.stats.merge_ns << ","
+                  << r.nodes << "," << r.stats.depth_nodes.size() << "," << r.stats.mean_rollout_length() << "," << r.peak_rss_kb << "," << r.live_kb << std::endl;
+    }
+}
+
+void print_json(const std::vector<Result>& results, uint64_t seed)
+{
+    std::cout << "{\"seed\": " << seed << ", \"results\": [" << std::endl;
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        std::cout << "  {\"name\": \"" << r.name << "\", \"roots\": " << r.roots << ", \"iterations\": " << r.iterations << ", \"seconds\": " << r.seconds << ", \"iterations_per_second\": " << r.iterations / r.seconds
+                  << ", \"ns_per_iteration\": {\"select\": " << per_iteration(r.stats.select_ns, r) << ", \"expand\": " << per_iteration(r.stats.expand_ns, r) << ", \"simulate\": " << per_iteration(r.stats.simulate_ns, r) << ", \"backprop\": " << per_iteration(r.stats.backprop_ns, r) << "}"
+                  << ", \"merge_ns\": " << r.stats.merge_ns << ", \"nodes\": " << r.nodes << ", \"depth\": " << r.stats.depth_nodes.size() << ", \"mean_rollout_length\": " << r.stats.mean_rollout_length() << ", \"peak_rss_kb\": " << r.peak_rss_kb << ", \"live_kb\": " << r.live_kb << "}" << ((i + 1 < results.size()) ? "," : "") << std::endl;
+    }
+    std::cout << "]}" << std::endl;
+}
+
+MCTS_DECLARE_DYN_PARAM(double, Params::uct, c);
+MCTS_DECLARE_DYN_PARAM(size_t, Params::mcts_node, parallel_roots);
+
+int main(int argc, char** argv)
+{
+    bool json = true;
+    uint64_t seed = 1;
+    std::string filter = "";
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--csv") == 0)
+            json = false;
+        else if (std::strcmp(argv[i], "--json") == 0)
+            json = true;
+        else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            seed = std::stoull(argv[++i]);
+        else
+            filter = argv[i];
+    }
+
+    // fixed seed: the trees (and thus the work done) are the same from one run to the other
+    mcts::rng::seed(seed);
+    mcts::par::init();
+
+    std::vector<Result> results;
+    for (size_t roots : {size_t(1), size_t(4)}) {
+        std::string suffix = (roots > 1) ? "_roots" : "_serial";
+        if (("grid" + suffix).find(filter) != std::string::npos)
+            results.push_back(run<grid::tree_type>("grid" + suffix, 10.0, roots, 20000, 100, 0.9, grid::RewardFunction()));
+        if (("trap" + suffix).find(filter) != std::string::npos)
+            results.push_back(run<trap::tree_type>("trap" + suffix, 50.0, roots, 50000, 2, 1.0, trap::RewardFunction()));
+        if (("toy" + suffix).find(filter) != std::string::npos)
+            results.push_back(run<toy::tree_type>("toy" + suffix, 50.0, roots, 20000, 200, 0.9, toy::RewardFunction()));
+        if (("trap_open_loop" + suffix).find(filter) != std::string::npos)
+            results.push_back(run<trap::open_loop_type>("trap_open_loop" + suffix, 50.0, roots, 50000, 2, 1.0, trap::RewardFunction()));
+        if (("toy_open_loop" + suffix).find(filter) != std::string::npos)
+            results.push_back(run<toy::open_loop_type>("toy_open_loop" + suffix, 50.0, roots, 20000, 200, 0.9, toy::RewardFunction()));
+        if (("grid_arena" + suffix).find(filter) != std::string::npos)
+            results.push_back(run<grid::arena_type>("grid_arena" + suffix, 10.0, roots, 20000, 100, 0.9, grid::RewardFunction()));
+        if (("trap_arena" + suffix).find(filter) != std::string::npos)
+            results.push_back(run<trap::arena_type>("trap_arena" + suffix, 50.0, roots, 50000, 2, 1.0, trap::RewardFunction()));
+        if (("toy_arena" + suffix).find(filter) != std::string::npos)
+            results.push_back(run<toy::arena_type>("toy_arena" + suffix, 50.0, roots, 20000, 200, 0.9, toy::RewardFunction()));
+    }
+
+    // tree reuse, with both storages (serial and with parallel roots)
+    bool bounded = true;
+    for (size_t roots : {size_t(1), size_t(4)}) {
+        for (bool arena : {false, true}) {
+            std::string name = std::string(arena ? "toy_arena_reroot" : "toy_reroot") + ((roots > 1) ? "_roots" : "");
+            if (name.find(filter) == std::string::npos)
+                continue;
+            bool ok;
+            if (arena)
+                results.push_back(run_reroot<toy::arena_type>(name, 50.0, roots, 40, 20000, 200, 0.9, toy::RewardFunction(), ok));
+            else
+                results.push_back(run_reroot<toy::tree_type>(name, 50.0, roots, 40, 20000, 200, 0.9, toy::RewardFunction(), ok));
+            bounded = bounded && ok;
+        }
+    }
+
+    if (json)
+        print_json(results, seed);
+    else
+        print_csv(results);
+
+    return bounded ? 0 : 1;
+}
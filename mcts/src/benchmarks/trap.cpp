@@ -1,5 +1,8 @@
 #include <iostream>
+#include <array>
 #include <ctime>
+#include <chrono>
+#include <string>
 #include <mcts/uct.hpp>
 
 struct Params {
@@ -21,6 +24,7 @@ struct Params {
 #else
         MCTS_PARAM(size_t, parallel_roots, 4);
 #endif
+        MCTS_PARAM(double, virtual_loss, 100.0);
     };
 };
 
@@ -34,7 +38,7 @@ namespace global {
 struct SimpleState {
     double _x, _R;
     int _time;
-    const double _epsilon = 1e-6;
+    static constexpr double _epsilon = 1e-6;
 
     SimpleState()
     {
@@ -57,12 +61,12 @@ struct SimpleState {
 
     double random_action() const
     {
-        return (std::rand() / double(RAND_MAX));
+        return mcts::rng::uniform();
     }
 
     SimpleState move(double d) const
     {
-        double x_new = _x + d + _R * (std::rand() / double(RAND_MAX));
+        double x_new = _x + d + _R * mcts::rng::uniform();
         return SimpleState(x_new, _time + 1, _R);
     }
 
@@ -76,26 +80,44 @@ struct SimpleState {
         double dx = _x - other._x;
         return ((dx * dx) < _epsilon);
     }
+
+    // cells of the size of the equality tolerance: an equal state is in the same cell or in a neighbouring one
+    size_t hash() const
+    {
+        return std::hash<long>()(_cell());
+    }
+
+    std::array<size_t, 3> hash_cells() const
+    {
+        long c = _cell();
+        return {{std::hash<long>()(c - 1), std::hash<long>()(c), std::hash<long>()(c + 1)}};
+    }
+
+    long _cell() const
+    {
+        return static_cast<long>(std::floor(_x / std::sqrt(_epsilon)));
+    }
 };
 
 struct RewardFunction {
     template <typename State>
-    double operator()(std::shared_ptr<State> from_state, double action, std::shared_ptr<State> to_state)
+    double operator()(const State& from_state, double action, const State& to_state)
     {
-        if (to_state->_x < global::l)
+        if (to_state._x < global::l)
             return global::a;
-        else if (to_state->_x < (global::l + global::w))
+        else if (to_state._x < (global::l + global::w))
             return 0.0;
-        else if (to_state->_x > (global::l + global::w))
+        else if (to_state._x > (global::l + global::w))
             return global::h;
         assert(false);
         return 0.0;
     }
 };
 
-int main()
+int main(int argc, char** argv)
 {
-    std::srand(std::time(0));
+    // pass a seed to repeat a run
+    mcts::rng::seed((argc > 1) ? std::stoull(argv[1]) : std::time(0));
     mcts::par::init();
 
     RewardFunction world;
@@ -107,7 +129,7 @@ int main()
     auto tree = std::make_shared<mcts::MCTSNode<Params, SimpleState, mcts::SimpleStateInit<SimpleState>, mcts::SimpleValueInit, mcts::UCTValue<Params>, mcts::UniformRandomPolicy<SimpleState, double>, double, mcts::SPWSelectPolicy<Params>, mcts::ContinuousOutcomeSelect<Params>>>(init, 2, 1.0);
 #endif
 
-#ifdef SINGLE
+#if defined(SINGLE) || defined(TREE)
     const int n_iter = 50000;
 #else
     const int n_iter = 18000;
@@ -115,7 +137,11 @@ int main()
 
     auto t1 = std::chrono::steady_clock::now();
 
+#ifdef TREE
+    tree->compute_tree_parallel(world, n_iter);
+#else
     tree->compute(world, n_iter);
+#endif
 
     auto time_running = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t1).count();
     std::cout << "Time in sec: " << time_running / 1000.0 << std::endl;
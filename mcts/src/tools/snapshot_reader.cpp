@@ -0,0 +1,104 @@
+// Reader of the tree snapshots of mcts/snapshot.hpp.
+// Usage: snapshot_reader FILE [--dump DEPTH]
+// Prints the shape of the tree (nodes, actions and visits at every depth) and the actions of the root
+// (visits, mean value); --dump prints every node and action down to DEPTH. The serialized states and
+// actions are shown as lists of doubles when their size is a multiple of 8 bytes, in hex otherwise.
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <mcts/snapshot.hpp>
+
+std::string show(const std::string& bytes)
+{
+    std::string s;
+    char buf[32];
+    if (bytes.size() % sizeof(double) == 0) {
+        for (size_t i = 0; i < bytes.size(); i += sizeof(double)) {
+            double v;
+            std::memcpy(&v, &bytes[i], sizeof(double));
+            std::snprintf(buf, sizeof(buf), (i == 0) ? "%g" : " %g", v);
+            s += buf;
+        }
+    }
+    else {
+        for (unsigned char c : bytes) {
+            std::snprintf(buf, sizeof(buf), "%02x", c);
+            s += buf;
+        }
+    }
+    return "[" + s + "]";
+}
+
+struct RootAction {
+    uint32_t visits;
+    double value;
+    std::string action;
+};
+
+struct Reader {
+    int dump_depth = -1;
+    std::vector<size_t> nodes, actions, visits;
+    std::vector<RootAction> root_actions;
+
+    void node(size_t depth, uint32_t n, const std::string& state)
+    {
+        if (nodes.size() <= depth) {
+            nodes.resize(depth + 1, 0);
+            actions.resize(depth + 1, 0);
+            visits.resize(depth + 1, 0);
+        }
+        nodes[depth]++;
+        visits[depth] += n;
+        if (int(depth) <= dump_depth)
+            std::cout << std::string(4 * depth, ' ') << "node visits: " << n << " state: " << show(state) << std::endl;
+    }
+
+    void action(size_t depth, uint32_t n, double value, const std::string& action)
+    {
+        actions[depth]++;
+        if (depth == 0)
+            root_actions.push_back(RootAction{n, value, action});
+        if (int(depth) <= dump_depth)
+            std::cout << std::string(4 * depth + 2, ' ') << "action visits: " << n << " mean: " << value / std::max(double(n), 1.0) << " action: " << show(action) << std::endl;
+    }
+};
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " FILE [--dump DEPTH]" << std::endl;
+        return 1;
+    }
+
+    Reader reader;
+    for (int i = 2; i < argc; i++) {
+        if (std::strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+            reader.dump_depth = std::stoi(argv[++i]);
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::cerr << "Cannot open " << argv[1] << std::endl;
+        return 1;
+    }
+    if (!mcts::snapshot::read(in, reader)) {
+        std::cerr << argv[1] << " is not a complete snapshot (version " << mcts::snapshot::version << ")" << std::endl;
+        return 1;
+    }
+
+    std::cout << "depth nodes actions visits" << std::endl;
+    for (size_t d = 0; d < reader.nodes.size(); d++)
+        std::cout << d << " " << reader.nodes[d] << " " << reader.actions[d] << " " << reader.visits[d] << std::endl;
+
+    std::sort(reader.root_actions.begin(), reader.root_actions.end(), [](const RootAction& a, const RootAction& b) { return a.visits > b.visits; });
+    std::cout << "root actions (most visited first): visits mean action" << std::endl;
+    for (const auto& a : reader.root_actions)
+        std::cout << a.visits << " " << a.value / std::max(double(a.visits), 1.0) << " " << show(a.action) << std::endl;
+
+    return 0;
+}
@@ -1,18 +1,8 @@
 #include <iostream>
 #include <ctime>
+#include <chrono>
 #include <mcts/uct.hpp>
 
-template <typename T>
-inline T gaussian_rand(T m = 0.0, T v = 1.0)
-{
-    std::random_device rd;
-    std::mt19937 gen(rd());
-
-    std::normal_distribution<T> gaussian(m, v);
-
-    return gaussian(gen);
-}
-
 struct Params {
     struct uct {
         MCTS_PARAM(double, c, 50.0);
@@ -41,7 +31,7 @@ namespace global {
 
 struct SimpleState {
     double _x, _y;
-    const double _epsilon = 1e-6;
+    static constexpr double _epsilon = 1e-6;
 
     SimpleState()
     {
@@ -57,7 +47,7 @@ struct SimpleState {
     double next_action() const
     {
         // using domain knowledge - have to check literature
-        double th = gaussian_rand(best_action(), 0.3);
+        double th = mcts::rng::gaussian(best_action(), 0.3);
         if (th > M_PI)
             th -= 2 * M_PI;
         if (th < -M_PI)
@@ -67,7 +57,7 @@ struct SimpleState {
 
     double random_action() const
     {
-        return (std::rand() * 2.0 * M_PI / double(RAND_MAX) - M_PI);
+        return mcts::rng::uniform(-M_PI, M_PI);
     }
 
     double best_action() const
@@ -85,7 +75,7 @@ struct SimpleState {
         double r = 0.1;
         double th = theta;
         if (prob) {
-            double p = std::rand() / double(RAND_MAX);
+            double p = mcts::rng::uniform();
             if (p < 0.2) {
                 th += 0.1;
                 if (th > M_PI)
@@ -120,9 +110,9 @@ struct SimpleState {
 
 struct RewardFunction {
     template <typename State>
-    double operator()(std::shared_ptr<State> from_state, double action, std::shared_ptr<State> to_state)
+    double operator()(const State& from_state, double action, const State& to_state)
     {
-        if (to_state->terminal())
+        if (to_state.terminal())
             return 10.0;
         return -1.0;
     }
@@ -140,7 +130,7 @@ namespace mcts {
 
 int main()
 {
-    std::srand(std::time(0));
+    mcts::rng::seed(std::time(0));
     mcts::par::init();
 
     global::goal_x = 2.0;
@@ -75,7 +75,7 @@ struct GridState {
     {
         int x_new = _x, y_new = _y;
 
-        double r = std::rand() / (double)RAND_MAX;
+        double r = mcts::rng::uniform();
         if ((r - _prob) < 0 && prob)
             action = (action + 1) % 4;
 
@@ -113,7 +113,7 @@ struct GridState {
     {
         size_t act;
         do {
-            act = static_cast<size_t>(std::rand() * 4.0 / (double)RAND_MAX);
+            act = mcts::rng::uniform_int<size_t>(0, 3);
         } while (!valid(act));
 
         return act;
@@ -182,9 +182,26 @@ struct BestHeuristicPolicy {
     }
 };
 
+// the search stops once the best action goes towards the goal (up or right, without hitting the border)
+struct GoalDirectionStop {
+    GridState _init;
+    size_t _min_iterations;
+
+    template <typename Node>
+    bool operator()(const Node& node, size_t iterations)
+    {
+        if (iterations <= _min_iterations)
+            return false;
+        auto best = node.best_action();
+        if (best == nullptr || (best->action() != 0 && best->action() != 2))
+            return false;
+        return !(_init._x == (GOAL - 1) && best->action() != 0) && !(_init._y == (GOAL - 1) && best->action() != 2);
+    }
+};
+
 int main()
 {
-    std::srand(std::time(0));
+    mcts::rng::seed(std::time(0));
     mcts::par::init();
 
     GridWorld world;
@@ -208,17 +225,7 @@ int main()
                     auto tree = std::make_shared<mcts::MCTSNode<Params, GridState, mcts::SimpleStateInit<GridState>, mcts::SimpleValueInit, mcts::UCTValue<Params>, BestHeuristicPolicy<GridState, size_t>, size_t, mcts::SimpleSelectPolicy, mcts::SimpleOutcomeSelect>>(init, 10000);
                     const int N_ITERATIONS = 10000;
                     const int MIN_ITERATIONS = 1000;
-                    int k;
-                    for (k = 0; k < N_ITERATIONS; ++k) {
-                        tree->iterate(world);
-                        if (k >= MIN_ITERATIONS) {
-                            auto best = tree->best_action();
-                            if (best != nullptr && (best->action() == 0 || best->action() == 2)) {
-                                if (!(init._x == (s - 1) && best->action() != 0) && !(init._y == (s - 1) && best->action() != 2))
-                                    break;
-                            }
-                        }
-                    }
+                    size_t k = tree->compute(world, N_ITERATIONS, GoalDirectionStop{init, MIN_ITERATIONS});
                     auto time_running = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t1).count();
                     avg_time += time_running / 1000.0;
                     avg += k;
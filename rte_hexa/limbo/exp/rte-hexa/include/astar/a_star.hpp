@@ -2,8 +2,13 @@
 #define MCTS_ASTAR_A_STAR_HPP
 
 #include <vector>
-#include <map>
 #include <algorithm>
+#include <functional>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <atomic>
+#include <ostream>
 
 namespace astar {
     struct Node {
@@ -72,66 +77,188 @@ namespace astar {
         }
     };
 
+    // bumped by invalidate()
+    inline std::atomic<uint32_t>& _map_generation()
+    {
+        static std::atomic<uint32_t> generation(0);
+        return generation;
+    }
+
+    /// the obstacles changed: the edges cached by AStar::search() (in all the threads) are checked again
+    inline void invalidate()
+    {
+        _map_generation()++;
+    }
+
+    /// A* on the Nx x Ny grid with 8-connectivity. The scores live in flat arrays indexed by cell, reset
+    /// with generation stamps (nothing is cleared between searches), and the open set is a binary heap.
+    /// The arrays are kept per thread, together with the validity of the edges: when `colliding` wraps a
+    /// plain function, it is assumed to depend only on its arguments and on the map, and every edge is
+    /// checked once per thread until invalidate() is called (or a search uses another function or grid
+    /// size), so invalidate() must follow every change of the obstacles; other callables are checked
+    /// once per search.
     template <typename Heuristic = Euclidean, typename Cost = SimpleCost>
     struct AStar {
         std::vector<Node> search(const Node& start, const Node& goal, std::function<bool(int, int, int, int)> colliding, int Nx, int Ny)
         {
-            std::map<Node, Node> came_from;
-            std::vector<Node> closed_set;
-            std::vector<Node> open_set;
-            open_set.push_back(start);
-
-            std::map<Node, double> g_score, f_score;
-            for (int x = 0; x < Nx; x++) {
-                for (int y = 0; y < Ny; y++) {
-                    Node tmp(x, y, Nx, Ny);
-                    g_score[tmp] = std::numeric_limits<double>::max();
-                    f_score[tmp] = std::numeric_limits<double>::max();
-                }
-            }
-            g_score[start] = 0.0;
-            f_score[start] = Heuristic()(start, goal);
+            if (start == goal)
+                return std::vector<Node>(1, start);
+            if (!_inside(goal, Nx, Ny))
+                return std::vector<Node>();
 
-            // std::cout << "Start: " << start << std::endl;
-            // std::cout << "Goal: " << goal << std::endl;
+            Workspace& w = _workspace();
+            w.reset(Nx, Ny, colliding);
 
-            while (open_set.size() > 0) {
-                std::sort(open_set.begin(), open_set.end(), [&f_score](const Node& a, const Node& b) { auto it1 = f_score.find(a); auto it2 = f_score.find(b); if(it2 == f_score.end()) return true; if(it1 == f_score.end()) return false; return (f_score[a]<f_score[b]); });
-                Node current = open_set[0];
-                if (current == goal) {
-                    return _path(came_from, current);
+            // a start outside of the grid only has its neighbours in the grid
+            bool outside = !_inside(start, Nx, Ny);
+            if (outside) {
+                for (int d = 0; d < 8; d++) {
+                    int x_new = start._x + _dx(d), y_new = start._y + _dy(d);
+                    Node neigh(x_new, y_new, Nx, Ny);
+                    if (_inside(neigh, Nx, Ny) && !colliding(start._x, start._y, x_new, y_new))
+                        _relax(w, -1, x_new * Ny + y_new, Cost()(start, neigh), neigh, goal);
                 }
+            }
+            else {
+                int s = start._x * Ny + start._y;
+                w.seen[s] = w.generation;
+                w.g[s] = 0.0;
+                w.parent[s] = -1;
+                _push(w, Heuristic()(start, goal), s);
+            }
 
-                open_set.erase(open_set.begin());
-                closed_set.push_back(current);
+            int target = goal._x * Ny + goal._y;
+            while (!w.heap.empty()) {
+                std::pop_heap(w.heap.begin(), w.heap.end(), std::greater<Entry>());
+                int current = w.heap.back().second;
+                w.heap.pop_back();
+                if (w.closed[current] == w.generation)
+                    continue;
+                if (current == target)
+                    return _path(w, current, start, outside, Nx, Ny);
+                w.closed[current] = w.generation;
 
-                for (auto neigh : current.neighbours(colliding)) {
-                    if (std::find(closed_set.begin(), closed_set.end(), neigh) != closed_set.end())
+                Node node(current / Ny, current % Ny, Nx, Ny);
+                for (int d = 0; d < 8; d++) {
+                    int x_new = node._x + _dx(d), y_new = node._y + _dy(d);
+                    if (x_new < 0 || x_new >= Nx || y_new < 0 || y_new >= Ny)
                         continue;
-                    double tentative_score = g_score[current] + Cost()(current, neigh);
-                    if (std::find(open_set.begin(), open_set.end(), neigh) == open_set.end()) {
-                        open_set.push_back(neigh);
-                    }
-                    else if (tentative_score >= g_score[neigh])
+                    int next = x_new * Ny + y_new;
+                    if (w.closed[next] == w.generation || !w.edge_free(current * 8 + d, node._x, node._y, x_new, y_new, colliding))
                         continue;
-                    came_from[neigh] = current;
-                    g_score[neigh] = tentative_score;
-                    f_score[neigh] = g_score[neigh] + Heuristic()(neigh, goal);
+                    Node neigh(x_new, y_new, Nx, Ny);
+                    _relax(w, current, next, w.g[current] + Cost()(node, neigh), neigh, goal);
                 }
             }
 
             return std::vector<Node>();
         }
 
-        std::vector<Node> _path(std::map<Node, Node> came_from, Node current)
+    protected:
+        using Entry = std::pair<double, int>;
+
+        struct Workspace {
+            std::vector<double> g;
+            std::vector<int> parent;
+            // cell data is valid for this search iff its stamp is the current generation
+            std::vector<uint32_t> seen, closed;
+            uint32_t generation = 0;
+            std::vector<Entry> heap;
+
+            // edge d of cell c (index 8 * c + d) is known iff its stamp is edge_generation
+            std::vector<uint32_t> edge_stamp;
+            std::vector<uint8_t> edge_valid;
+            uint32_t edge_generation = 0;
+            bool (*edge_function)(int, int, int, int) = nullptr;
+            uint32_t map_generation = 0;
+
+            void reset(int Nx, int Ny, const std::function<bool(int, int, int, int)>& colliding)
+            {
+                size_t cells = size_t(Nx) * size_t(Ny);
+                auto function = colliding.target<bool (*)(int, int, int, int)>();
+                uint32_t current_map = _map_generation().load();
+                bool cached = function && *function == edge_function && map_generation == current_map && edge_stamp.size() == 8 * cells && g.size() == cells;
+                if (g.size() != cells) {
+                    g.assign(cells, 0.0);
+                    parent.assign(cells, -1);
+                    seen.assign(cells, 0);
+                    closed.assign(cells, 0);
+                    edge_stamp.assign(8 * cells, 0);
+                    edge_valid.assign(8 * cells, 0);
+                    generation = edge_generation = 0;
+                }
+                if (++generation == 0) {
+                    std::fill(seen.begin(), seen.end(), 0);
+                    std::fill(closed.begin(), closed.end(), 0);
+                    generation = 1;
+                }
+                if (!cached && ++edge_generation == 0) {
+                    std::fill(edge_stamp.begin(), edge_stamp.end(), 0);
+                    edge_generation = 1;
+                }
+                edge_function = function ? *function : nullptr;
+                map_generation = current_map;
+                heap.clear();
+            }
+
+            bool edge_free(size_t e, int x, int y, int x_new, int y_new, const std::function<bool(int, int, int, int)>& colliding)
+            {
+                if (edge_stamp[e] != edge_generation) {
+                    edge_stamp[e] = edge_generation;
+                    edge_valid[e] = !colliding(x, y, x_new, y_new);
+                }
+                return edge_valid[e];
+            }
+        };
+
+        static Workspace& _workspace()
+        {
+            static thread_local Workspace w;
+            return w;
+        }
+
+        // neighbour d in the order of Node::neighbours()
+        static int _dx(int d)
+        {
+            static const int dx[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+            return dx[d];
+        }
+
+        static int _dy(int d)
+        {
+            static const int dy[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+            return dy[d];
+        }
+
+        static bool _inside(const Node& n, int Nx, int Ny)
+        {
+            return n._x >= 0 && n._x < Nx && n._y >= 0 && n._y < Ny;
+        }
+
+        static void _push(Workspace& w, double f, int cell)
+        {
+            w.heap.push_back(Entry(f, cell));
+            std::push_heap(w.heap.begin(), w.heap.end(), std::greater<Entry>());
+        }
+
+        // better path to `next` through `from`: pushed again, the old heap entry is skipped once closed
+        static void _relax(Workspace& w, int from, int next, double score, const Node& neigh, const Node& goal)
+        {
+            if (w.seen[next] == w.generation && score >= w.g[next])
+                return;
+            w.seen[next] = w.generation;
+            w.g[next] = score;
+            w.parent[next] = from;
+            _push(w, score + Heuristic()(neigh, goal), next);
+        }
+
+        static std::vector<Node> _path(const Workspace& w, int current, const Node& start, bool outside, int Nx, int Ny)
         {
             std::vector<Node> total_path;
-            total_path.push_back(current);
-            auto cur = current;
-            while (came_from.find(cur) != came_from.end()) {
-                cur = came_from[cur];
-                total_path.push_back(cur);
-            }
+            for (int c = current; c != -1; c = w.parent[c])
+                total_path.push_back(Node(c / Ny, c % Ny, Nx, Ny));
+            if (outside)
+                total_path.push_back(start);
 
             std::reverse(total_path.begin(), total_path.end());
             return total_path;
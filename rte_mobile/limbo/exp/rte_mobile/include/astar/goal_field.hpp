@@ -0,0 +1,125 @@
+#ifndef MCTS_ASTAR_GOAL_FIELD_HPP
+#define MCTS_ASTAR_GOAL_FIELD_HPP
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <astar/a_star.hpp>
+
+namespace astar {
+    /// Shortest paths from every cell of the Nx x Ny grid to a fixed goal (8-connectivity, one per move as
+    /// with AStar<>), computed once by a breadth-first search from the goal: for a fixed goal, path()
+    /// replaces AStar::search() and reads the path cell by cell (next cell and distance of every cell).
+    class GoalField {
+    public:
+        GoalField() : _n_x(0), _n_y(0) {}
+
+        void build(const Node& goal, std::function<bool(int, int, int, int)> colliding, int Nx, int Ny)
+        {
+            _goal = goal;
+            _colliding = colliding;
+            _n_x = Nx;
+            _n_y = Ny;
+            _distance.assign(size_t(Nx) * size_t(Ny), -1);
+            _next.assign(size_t(Nx) * size_t(Ny), -1);
+            if (!_inside(goal._x, goal._y))
+                return;
+
+            std::deque<int> queue;
+            _distance[_cell(goal._x, goal._y)] = 0;
+            queue.push_back(_cell(goal._x, goal._y));
+            while (!queue.empty()) {
+                int current = queue.front();
+                queue.pop_front();
+                int x = current / Ny, y = current % Ny;
+                // cells with a move to the current cell
+                for (int i = -1; i <= 1; i++) {
+                    for (int j = -1; j <= 1; j++) {
+                        if (i == 0 && j == 0)
+                            continue;
+                        int x_prev = x + i;
+                        int y_prev = y + j;
+                        if (!_inside(x_prev, y_prev))
+                            continue;
+                        int prev = _cell(x_prev, y_prev);
+                        if (_distance[prev] >= 0 || colliding(x_prev, y_prev, x, y))
+                            continue;
+                        _distance[prev] = _distance[current] + 1;
+                        _next[prev] = current;
+                        queue.push_back(prev);
+                    }
+                }
+            }
+        }
+
+        /// number of moves from start to the goal (-1 if it cannot be reached)
+        int distance(const Node& start) const
+        {
+            if (start == _goal)
+                return 0;
+            int cell = _entry(start);
+            return (cell < 0) ? -1 : _distance[cell] + (_inside(start._x, start._y) ? 0 : 1);
+        }
+
+        /// the first `max_nodes` nodes of a shortest path from start to the goal, both included (as
+        /// AStar::search() returns it); empty if the goal cannot be reached
+        std::vector<Node> path(const Node& start, size_t max_nodes = std::numeric_limits<size_t>::max()) const
+        {
+            std::vector<Node> total_path;
+            if (start == _goal)
+                return std::vector<Node>(1, start);
+            int cell = _entry(start);
+            if (cell < 0)
+                return total_path;
+
+            total_path.push_back(start);
+            if (_inside(start._x, start._y))
+                cell = _next[cell];
+            for (; cell >= 0 && total_path.size() < max_nodes; cell = _next[cell])
+                total_path.push_back(Node(cell / _n_y, cell % _n_y, _n_x, _n_y));
+            return total_path;
+        }
+
+    protected:
+        bool _inside(int x, int y) const
+        {
+            return x >= 0 && x < _n_x && y >= 0 && y < _n_y;
+        }
+
+        int _cell(int x, int y) const
+        {
+            return x * _n_y + y;
+        }
+
+        // cell of start (or of its closest neighbour to the goal for a start outside of the grid)
+        // from which the goal can be reached; -1 if none
+        int _entry(const Node& start) const
+        {
+            if (_inside(start._x, start._y))
+                return (_distance[_cell(start._x, start._y)] >= 0) ? _cell(start._x, start._y) : -1;
+
+            int best = -1;
+            for (int i = -1; i <= 1; i++) {
+                for (int j = -1; j <= 1; j++) {
+                    int x_new = start._x + i;
+                    int y_new = start._y + j;
+                    if ((i == 0 && j == 0) || !_inside(x_new, y_new))
+                        continue;
+                    int cell = _cell(x_new, y_new);
+                    if (_distance[cell] >= 0 && (best < 0 || _distance[cell] < _distance[best]) && !_colliding(start._x, start._y, x_new, y_new))
+                        best = cell;
+                }
+            }
+            return best;
+        }
+
+        Node _goal;
+        std::function<bool(int, int, int, int)> _colliding;
+        int _n_x, _n_y;
+        // moves to the goal (-1: unreachable) and next cell on the way (-1: goal or unreachable)
+        std::vector<int> _distance, _next;
+    };
+}
+
+#endif
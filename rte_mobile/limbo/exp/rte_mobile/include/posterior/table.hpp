@@ -0,0 +1,124 @@
+#ifndef POSTERIOR_TABLE_HPP
+#define POSTERIOR_TABLE_HPP
+
+#include <vector>
+#include <tuple>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <Eigen/Core>
+
+namespace posterior {
+    /// Posterior of a GP (mean and variance, as GP::query() returns them) at a fixed set of points, for
+    /// GPs that are only queried at these points (e.g. the behaviors of an archive). reset() computes it
+    /// from the GP; add_sample() adds a sample at one of the points to the GP and updates the table with
+    /// the rank-one update of the posterior: O(N n) for N points and n samples, instead of N queries in
+    /// O(n^2) each. The table keeps L^-1 K(samples, points) (N x n doubles); GPs without blacklisted samples.
+    template <typename GP>
+    class Table {
+    public:
+        Table() : _n(0) {}
+
+        void reset(const GP& gp, const std::vector<Eigen::VectorXd>& points)
+        {
+            _points = points;
+            reset(gp);
+        }
+
+        /// recompute the posterior at the same points (e.g. after samples added to the GP directly)
+        void reset(const GP& gp)
+        {
+            const auto& points = _points;
+            _n = 0;
+            size_t N = points.size();
+            if (N == 0) {
+                _mu.resize(0, 0);
+                _var.resize(0);
+                _z.resize(0, 0);
+                return;
+            }
+
+            Eigen::VectorXd m = gp.mean_function()(points[0], gp);
+            _mu.resize(N, m.size());
+            _var.resize(N);
+            for (size_t i = 0; i < N; i++) {
+                _mu.row(i) = gp.mean_function()(points[i], gp).transpose();
+                _var(i) = gp.kernel_function()(points[i], points[i]);
+            }
+
+            const auto& samples = gp.samples();
+            _n = samples.size();
+            _z.resize(N, std::max<size_t>(2 * _n, 16));
+            if (_n == 0)
+                return;
+
+            Eigen::MatrixXd k(_n, N);
+            for (size_t j = 0; j < N; j++)
+                for (size_t i = 0; i < _n; i++)
+                    k(i, j) = gp.kernel_function()(samples[i], points[j]);
+            _mu += k.transpose() * gp.alpha();
+            Eigen::MatrixXd z = gp.matrixL().template triangularView<Eigen::Lower>().solve(k);
+            _var -= z.colwise().squaredNorm().transpose();
+            _z.leftCols(_n) = z.transpose();
+        }
+
+        /// add the sample (points[i], observation) to the GP and update the posterior of all the points
+        void add_sample(GP& gp, size_t i, const Eigen::VectorXd& observation, double noise)
+        {
+            size_t N = _points.size();
+            const Eigen::VectorXd& x = _points[i];
+
+            // posterior covariances with the new sample and variance of its observation
+            Eigen::VectorXd c(N);
+            for (size_t j = 0; j < N; j++)
+                c(j) = gp.kernel_function()(_points[j], x);
+            if (_n > 0)
+                c -= _z.leftCols(_n) * _z.row(i).head(_n).transpose();
+            double s = _var(i) + noise;
+
+            Eigen::RowVectorXd innovation = observation.transpose() - _mu.row(i);
+            _mu += c * innovation / s;
+            _var -= c.cwiseAbs2() / s;
+
+            // next row of L^-1 K(samples, points)
+            if (_n == size_t(_z.cols()))
+                _z.conservativeResize(N, 2 * _n);
+            _z.col(_n) = c / std::sqrt(s);
+            _n++;
+
+            gp.add_sample(x, observation, noise);
+        }
+
+        size_t size() const
+        {
+            return _points.size();
+        }
+
+        Eigen::VectorXd mu(size_t i) const
+        {
+            return _mu.row(i).transpose();
+        }
+
+        /// variance, clamped at 0 as GP::sigma() does
+        double sigma(size_t i) const
+        {
+            return (_var(i) <= std::numeric_limits<double>::epsilon()) ? 0 : _var(i);
+        }
+
+        std::tuple<Eigen::VectorXd, double> query(size_t i) const
+        {
+            return std::make_tuple(mu(i), sigma(i));
+        }
+
+    protected:
+        std::vector<Eigen::VectorXd> _points;
+        // number of samples (columns of _z in use)
+        size_t _n;
+        Eigen::MatrixXd _mu;
+        Eigen::VectorXd _var;
+        // row j: L^-1 K(samples, points[j]), with spare columns for the next samples
+        Eigen::MatrixXd _z;
+    };
+}
+
+#endif
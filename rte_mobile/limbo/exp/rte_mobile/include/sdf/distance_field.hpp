@@ -0,0 +1,165 @@
+#ifndef SDF_DISTANCE_FIELD_HPP
+#define SDF_DISTANCE_FIELD_HPP
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+
+namespace sdf {
+    /// Signed distance to a set of discs (the obstacles of a map), for collision queries that do not
+    /// depend on the number of discs. Built once on a grid of spacing `resolution`: every grid point keeps
+    /// the few discs that can be the closest one to a point of its cell, plus the ones at most one
+    /// resolution farther, so that the distances computed from them are exact (no discretization error).
+    /// Points outside the grid are checked against all the discs.
+    class DistanceField {
+    public:
+        DistanceField() : _built(false), _n_x(0), _n_y(0), _resolution(1.0), _x0(0.0), _y0(0.0) {}
+
+        /// obstacles: discs with _x, _y and _radius; the grid covers them plus `margin` on every side
+        template <typename Obstacle>
+        void build(const std::vector<Obstacle>& obstacles, double resolution, double margin)
+        {
+            _discs.clear();
+            _offsets.clear();
+            _candidates.clear();
+            _resolution = resolution;
+            _n_x = _n_y = 0;
+
+            double min_x = std::numeric_limits<double>::max(), min_y = min_x;
+            double max_x = std::numeric_limits<double>::lowest(), max_y = max_x;
+            for (const auto& obs : obstacles) {
+                _discs.push_back(Disc{obs._x, obs._y, obs._radius});
+                min_x = std::min(min_x, obs._x - obs._radius);
+                min_y = std::min(min_y, obs._y - obs._radius);
+                max_x = std::max(max_x, obs._x + obs._radius);
+                max_y = std::max(max_y, obs._y + obs._radius);
+            }
+
+            _offsets.push_back(0);
+            if (!_discs.empty()) {
+                _x0 = min_x - margin;
+                _y0 = min_y - margin;
+                _n_x = int(std::ceil((max_x + margin - _x0) / resolution)) + 1;
+                _n_y = int(std::ceil((max_y + margin - _y0) / resolution)) + 1;
+
+                // the closest disc to a point of the cell of a grid point is at most `slack` farther from
+                // the grid point than its closest disc (half a diagonal each way, plus one resolution)
+                double slack = resolution * (1.0 + std::sqrt(2.0));
+                std::vector<double> d(_discs.size());
+                for (int i = 0; i < _n_x; i++) {
+                    for (int j = 0; j < _n_y; j++) {
+                        double x = _x0 + i * resolution, y = _y0 + j * resolution;
+                        for (size_t k = 0; k < _discs.size(); k++)
+                            d[k] = _distance(_discs[k], x, y);
+                        double closest = *std::min_element(d.begin(), d.end());
+                        for (size_t k = 0; k < _discs.size(); k++)
+                            if (d[k] <= closest + slack)
+                                _candidates.push_back(uint32_t(k));
+                        _offsets.push_back(uint32_t(_candidates.size()));
+                    }
+                }
+            }
+
+            // last range: all the discs (for the points outside the grid)
+            for (size_t k = 0; k < _discs.size(); k++)
+                _candidates.push_back(uint32_t(k));
+            _offsets.push_back(uint32_t(_candidates.size()));
+            _built = true;
+        }
+
+        bool built() const
+        {
+            return _built;
+        }
+
+        /// distance from (x, y) to the closest disc (negative inside a disc, infinity without discs)
+        double distance(double x, double y) const
+        {
+            size_t cell = _cell(x, y);
+            double d = std::numeric_limits<double>::infinity();
+            for (uint32_t k = _offsets[cell]; k < _offsets[cell + 1]; k++)
+                d = std::min(d, _distance(_discs[_candidates[k]], x, y));
+            return d;
+        }
+
+        /// does a disc of radius r at (x, y) touch a disc of the field
+        bool collides(double x, double y, double r) const
+        {
+            return distance(x, y) <= r;
+        }
+
+        /// does a disc of radius r moved from (x0, y0) to (x1, y1) touch a disc of the field: the segment
+        /// is walked with steps of the free distance at the current point (at least one resolution, with an
+        /// exact check of the segment against the close discs when the free distance is shorter)
+        bool collides(double x0, double y0, double x1, double y1, double r) const
+        {
+            double length = std::sqrt((x1 - x0) * (x1 - x0) + (y1 - y0) * (y1 - y0));
+            if (length <= 0.0)
+                return collides(x0, y0, r);
+            double ux = (x1 - x0) / length, uy = (y1 - y0) / length;
+
+            double t = 0.0;
+            while (true) {
+                double x = x0 + t * ux, y = y0 + t * uy;
+                size_t cell = _cell(x, y);
+                double d = std::numeric_limits<double>::infinity();
+                for (uint32_t k = _offsets[cell]; k < _offsets[cell + 1]; k++)
+                    d = std::min(d, _distance(_discs[_candidates[k]], x, y));
+                if (d <= r)
+                    return true;
+                if (t >= length)
+                    return false;
+
+                double free = d - r;
+                if (free >= _resolution) {
+                    t = std::min(t + free, length);
+                    continue;
+                }
+
+                // a disc touching the next resolution of the path is at most d + resolution away from
+                // (x, y): it is in the range of this point
+                double step = std::min(_resolution, length - t);
+                for (uint32_t k = _offsets[cell]; k < _offsets[cell + 1]; k++) {
+                    const Disc& disc = _discs[_candidates[k]];
+                    double s = std::max(0.0, std::min(step, (disc.x - x) * ux + (disc.y - y) * uy));
+                    if (_distance(disc, x + s * ux, y + s * uy) <= r)
+                        return true;
+                }
+                t += step;
+            }
+        }
+
+    protected:
+        struct Disc {
+            double x, y, radius;
+        };
+
+        static double _distance(const Disc& disc, double x, double y)
+        {
+            double dx = x - disc.x;
+            double dy = y - disc.y;
+            return std::sqrt(dx * dx + dy * dy) - disc.radius;
+        }
+
+        // range of the closest grid point (the last range, with all the discs, outside the grid)
+        size_t _cell(double x, double y) const
+        {
+            double i = std::floor((x - _x0) / _resolution + 0.5);
+            double j = std::floor((y - _y0) / _resolution + 0.5);
+            if (i < 0.0 || j < 0.0 || i >= _n_x || j >= _n_y)
+                return size_t(_n_x) * size_t(_n_y);
+            return size_t(i) * size_t(_n_y) + size_t(j);
+        }
+
+        bool _built;
+        int _n_x, _n_y;
+        double _resolution, _x0, _y0;
+        std::vector<Disc> _discs;
+        // candidate discs of the grid point n: _candidates[_offsets[n]] to _candidates[_offsets[n + 1] - 1]
+        std::vector<uint32_t> _offsets, _candidates;
+    };
+}
+
+#endif
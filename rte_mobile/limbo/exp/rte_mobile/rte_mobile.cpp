@@ -2,10 +2,16 @@
 #include <libfastsim/fastsim.hpp>
 #include <map_elites/binary_map.hpp>
 #include <mcts/uct.hpp>
+#include <mcts/snapshot.hpp>
 #include <boost/program_options.hpp>
 #include <astar/a_star.hpp>
+#include <astar/goal_field.hpp>
+#include <sdf/distance_field.hpp>
+#include <posterior/table.hpp>
 #include <algorithm>
 #include <vector>
+#include <array>
+#include <unordered_map>
 #include <chrono>
 
 #define ARCHIVE_SIZE 2
@@ -15,10 +21,8 @@ using namespace limbo;
 template <typename T>
 inline T gaussian_rand(T m = 0.0, T v = 1.0)
 {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    std::normal_distribution<T> gaussian(m, v);
-    return gaussian(gen);
+    // per-thread stream: states are moved concurrently by the parallel trees
+    return mcts::rng::gaussian(m, v);
 }
 
 // b-a
@@ -47,6 +51,21 @@ struct Params {
 
     struct mcts_node {
         MCTS_DYN_PARAM(size_t, parallel_roots);
+        MCTS_DYN_PARAM(bool, parallel_tree);
+        MCTS_DYN_PARAM(bool, reuse_tree);
+        MCTS_DYN_PARAM(size_t, transposition_table);
+        MCTS_DYN_PARAM(size_t, rollout_depth);
+        MCTS_DYN_PARAM(bool, leaf_value);
+        MCTS_DYN_PARAM(size_t, candidate_actions);
+        MCTS_DYN_PARAM(bool, snapshots);
+        MCTS_DYN_PARAM(size_t, batch);
+        MCTS_PARAM(double, virtual_loss, 100.0);
+        MCTS_PARAM(double, gamma, 0.9);
+    };
+
+    struct stop {
+        MCTS_DYN_PARAM(double, visit_share);
+        MCTS_DYN_PARAM(size_t, min_iterations);
     };
 
     struct active_learning {
@@ -58,8 +77,10 @@ struct Params {
     MCTS_DYN_PARAM(double, goal_y);
     MCTS_DYN_PARAM(double, goal_theta);
     MCTS_DYN_PARAM(double, iterations);
+    MCTS_DYN_PARAM(double, time_budget);
     MCTS_DYN_PARAM(bool, learning);
     MCTS_DYN_PARAM(size_t, collisions);
+    MCTS_DYN_PARAM(bool, check);
     MCTS_PARAM(double, threshold, 1e-2);
 
     MCTS_PARAM(double, cell_size, 40.0);
@@ -73,6 +94,7 @@ struct Params {
 
     struct archiveparams {
         struct elem_archive {
+            Eigen::VectorXd desc;
             double x, y, cos_theta, sin_theta;
             std::vector<double> controller;
         };
@@ -99,8 +121,39 @@ struct Params {
             }
         };
 
-        using archive_t = std::map<std::vector<double>, elem_archive, classcomp>;
+        // descriptor rounded as classcompequal compares it
+        using key_t = std::array<long, ARCHIVE_SIZE>;
+
+        struct key_hash {
+            size_t operator()(const key_t& key) const
+            {
+                size_t seed = 0;
+                for (long k : key)
+                    mcts::hash_combine(seed, k);
+                return seed;
+            }
+        };
+
+        static key_t key(const Eigen::VectorXd& desc)
+        {
+            assert(desc.size() == ARCHIVE_SIZE);
+            key_t k;
+            for (int i = 0; i < ARCHIVE_SIZE; i++)
+                k[i] = static_cast<long>(std::round(desc[i] * 1000));
+            return k;
+        }
+
+        /// index of the behavior of a descriptor in the archive (-1 if it is not in it)
+        static int find(const Eigen::VectorXd& desc)
+        {
+            auto it = index.find(key(desc));
+            return (it == index.end()) ? -1 : int(it->second);
+        }
+
+        // the behaviors (ordered by classcomp, as the std::map they were loaded in) and the index of their descriptors
+        using archive_t = std::vector<elem_archive>;
         static archive_t archive;
+        static std::unordered_map<key_t, size_t, key_hash> index;
     };
 };
 
@@ -112,11 +165,12 @@ struct MeanArchive {
     template <typename GP>
     Eigen::VectorXd operator()(const Eigen::VectorXd& v, const GP&) const
     {
-        Eigen::VectorXd r(4);
-        std::vector<double> vv(v.size(), 0.0);
-        Eigen::VectorXd::Map(&vv[0], v.size()) = v;
-        typename Params::archiveparams::elem_archive elem = Params::archiveparams::archive[vv];
-        r << elem.x, elem.y, elem.cos_theta, elem.sin_theta;
+        Eigen::VectorXd r = Eigen::VectorXd::Zero(4);
+        int i = Params::archiveparams::find(v);
+        if (i >= 0) {
+            const auto& elem = Params::archiveparams::archive[i];
+            r << elem.x, elem.y, elem.cos_theta, elem.sin_theta;
+        }
         return r;
     }
 };
@@ -139,6 +193,8 @@ using GP_t = model::GP<Params, kernel_t, mean_t>;
 
 namespace global {
     GP_t gp_model(ARCHIVE_SIZE, 4);
+    // posterior of gp_model at the behaviors of the archive (same indices), updated by gp_add_sample()
+    posterior::Table<GP_t> gp_table;
 
     // fastsim things
     boost::shared_ptr<fastsim::Map> map;
@@ -149,6 +205,10 @@ namespace global {
     Eigen::Vector3d robot_pose;
 
     std::vector<SimpleObstacle> obstacles;
+    // distance field of the obstacles for the collision checks (built by init_map)
+    sdf::DistanceField obstacle_field;
+    // shortest paths on the grid to the current target (built by reach_target)
+    astar::GoalField goal_field;
     size_t map_size, map_size_x, map_size_y;
     size_t target_num;
 
@@ -156,7 +216,8 @@ namespace global {
     std::ofstream robot_file, ctrl_file, iter_file, misc_file;
 }
 
-bool collides(double x, double y, double r = Params::robot_radius())
+// exact checks against every obstacle (the distance field gives the same answers, see check_obstacle_field())
+bool collides_exact(double x, double y, double r)
 {
     for (size_t i = 0; i < global::obstacles.size(); i++) {
         double dx = x - global::obstacles[i]._x;
@@ -168,48 +229,58 @@ bool collides(double x, double y, double r = Params::robot_radius())
     return false;
 }
 
-bool collides_segment(const Eigen::Vector2d& start, const Eigen::Vector2d& end)
+// swept disc: the robot moving from start to end
+bool collides_exact(const Eigen::Vector2d& start, const Eigen::Vector2d& end, double r)
 {
-    const double epsilon = 1e-6;
-    double Dx = end(0) - start(0);
-    double Dy = end(1) - start(1);
-
+    Eigen::Vector2d dir = end - start;
+    double length_sq = dir.squaredNorm();
     for (size_t i = 0; i < global::obstacles.size(); i++) {
-        double Fx = start(0) - global::obstacles[i]._x;
-        double Fy = start(1) - global::obstacles[i]._y;
-
-        double a = Dx * Dx + Dy * Dy;
-        double b = 2.0 * (Fx * Dx + Fy * Dy);
-        double c = (Fx * Fx + Fy * Fy) - global::obstacles[i]._radius_sq;
-
-        double discriminant = b * b - 4.0 * a * c;
-        if (discriminant > epsilon) {
-            discriminant = std::sqrt(discriminant);
-
-            double t1 = (-b - discriminant) / (2.0 * a);
-            double t2 = (-b + discriminant) / (2.0 * a);
-
-            if (t1 > epsilon && (t1 - 1.0) < epsilon) {
-                return true;
-            }
-
-            if (t2 > epsilon && (t2 - 1.0) < epsilon) {
-                return true;
-            }
-        }
+        Eigen::Vector2d c(global::obstacles[i]._x, global::obstacles[i]._y);
+        double t = (length_sq > 0.0) ? std::max(0.0, std::min(1.0, (c - start).dot(dir) / length_sq)) : 0.0;
+        if ((start + t * dir - c).norm() <= global::obstacles[i]._radius + r)
+            return true;
     }
     return false;
 }
 
+bool collides(double x, double y, double r = Params::robot_radius())
+{
+    if (global::obstacle_field.built())
+        return global::obstacle_field.collides(x, y, r);
+    return collides_exact(x, y, r);
+}
+
 bool collides(const Eigen::Vector2d& start, const Eigen::Vector2d& end, double r = Params::robot_radius())
 {
-    Eigen::Vector2d dir = end - start;
-    Eigen::Vector2d perp = Eigen::Vector2d(-dir(1), dir(0));
-    Eigen::Vector2d A = start + perp * r;
-    Eigen::Vector2d B = end + perp * r;
-    Eigen::Vector2d C = end - perp * r;
-    Eigen::Vector2d D = start - perp * r;
-    return (collides(start(0), start(1), r) || collides(end(0), end(1), r) || collides_segment(A, B) || collides_segment(C, D)); //collides_segment(A, B) || collides_segment(B, C) || collides_segment(C, D) || collides_segment(D, A));
+    if (global::obstacle_field.built())
+        return global::obstacle_field.collides(start(0), start(1), end(0), end(1), r);
+    return collides_exact(start, end, r);
+}
+
+// --check: the distance field against the exact checks, on `n` random positions and moves of the map (the
+// robot radius and the larger ones of the planner, short moves and the moves between grid cells)
+bool check_obstacle_field(size_t n)
+{
+    double size_x = (global::map_size_x + 2) * Params::cell_size();
+    double size_y = (global::map_size_y + 2) * Params::cell_size();
+    const double radii[] = {Params::robot_radius(), 1.5 * Params::robot_radius(), 2.0 * Params::robot_radius()};
+    size_t mismatches = 0;
+    for (size_t i = 0; i < n; i++) {
+        Eigen::Vector2d s(mcts::rng::uniform(-Params::cell_size(), size_x), mcts::rng::uniform(-Params::cell_size(), size_y));
+        Eigen::Vector2d t = s + Eigen::Vector2d(mcts::rng::uniform(-2.0, 2.0), mcts::rng::uniform(-2.0, 2.0)) * Params::cell_size();
+        Eigen::Vector2d cell(std::round(s(0) / Params::cell_size()), std::round(s(1) / Params::cell_size()));
+        Eigen::Vector2d next = cell + Eigen::Vector2d(mcts::rng::uniform_int(-1, 1), mcts::rng::uniform_int(-1, 1));
+        double r = radii[i % 3];
+        if (collides(s(0), s(1), r) != collides_exact(s(0), s(1), r))
+            mismatches++;
+        if (collides(s, t, r) != collides_exact(s, t, r))
+            mismatches++;
+        if (collides(cell * Params::cell_size(), next * Params::cell_size(), r) != collides_exact(cell * Params::cell_size(), next * Params::cell_size(), r))
+            mismatches++;
+    }
+
+    std::cout << "Distance field check: " << 3 * n << " queries, " << mismatches << " mismatches" << std::endl;
+    return mismatches == 0;
 }
 
 // Stat GP
@@ -217,12 +288,11 @@ void write_gp(std::string filename)
 {
     std::ofstream ofs;
     ofs.open(filename);
-    typedef typename Params::archiveparams::archive_t::const_iterator archive_it_t;
-    for (archive_it_t it = Params::archiveparams::archive.begin(); it != Params::archiveparams::archive.end(); it++) {
-        Eigen::VectorXd desc = Eigen::VectorXd::Map(it->first.data(), it->first.size());
+    for (size_t i = 0; i < Params::archiveparams::archive.size(); i++) {
+        const Eigen::VectorXd& desc = Params::archiveparams::archive[i].desc;
         Eigen::VectorXd mu;
         double sigma;
-        std::tie(mu, sigma) = global::gp_model.query(desc);
+        std::tie(mu, sigma) = global::gp_table.query(i);
         ofs << desc.transpose() << " "
             << mu.transpose() << " "
             << sigma << std::endl;
@@ -230,6 +300,35 @@ void write_gp(std::string filename)
     ofs.close();
 }
 
+// GP predictions of several behaviors at once: query() in matrix form, with one kernel matrix
+// and one triangular solve for all of them (no sample: one query per behavior)
+std::vector<std::tuple<Eigen::VectorXd, double>> gp_query_batch(const std::vector<Eigen::VectorXd>& descs)
+{
+    std::vector<std::tuple<Eigen::VectorXd, double>> predictions;
+    predictions.reserve(descs.size());
+    if (global::gp_model.samples().empty()) {
+        for (const auto& desc : descs)
+            predictions.push_back(global::gp_model.query(desc));
+        return predictions;
+    }
+
+    const auto& samples = global::gp_model.samples();
+    Eigen::MatrixXd k(samples.size(), descs.size());
+    for (size_t j = 0; j < descs.size(); j++)
+        for (size_t i = 0; i < samples.size(); i++)
+            k(i, j) = global::gp_model.kernel_function()(samples[i], descs[j]);
+
+    Eigen::MatrixXd mu = k.transpose() * global::gp_model.alpha();
+    Eigen::MatrixXd z = global::gp_model.matrixL().triangularView<Eigen::Lower>().solve(k);
+    for (size_t j = 0; j < descs.size(); j++) {
+        Eigen::VectorXd m = mu.row(j).transpose() + global::gp_model.mean_function()(descs[j], global::gp_model);
+        double sigma = global::gp_model.kernel_function()(descs[j], descs[j]) - z.col(j).squaredNorm();
+        predictions.push_back(std::make_tuple(m, (sigma <= std::numeric_limits<double>::epsilon()) ? 0.0 : sigma));
+    }
+
+    return predictions;
+}
+
 bool astar_collides(int x, int y, int x_new, int y_new)
 {
     Eigen::Vector2d s(x * Params::cell_size(), y * Params::cell_size());
@@ -237,18 +336,40 @@ bool astar_collides(int x, int y, int x_new, int y_new)
     return collides(s, t, Params::robot_radius()); // * 1.5);
 }
 
+// --check: the goal field against AStar::search() from `n` random cells of the grid: the goal is reached from the
+// same cells, and A* (whose Euclidean heuristic overestimates the diagonal moves) finds no shorter path
+bool check_goal_field(const astar::Node& goal, size_t n)
+{
+    size_t mismatches = 0;
+    for (size_t i = 0; i < n; i++) {
+        astar::Node start(mcts::rng::uniform_int<int>(0, global::map_size_x - 1), mcts::rng::uniform_int<int>(0, global::map_size_y - 1), global::map_size_x, global::map_size_y);
+        auto path = astar::AStar<>().search(start, goal, astar_collides, global::map_size_x, global::map_size_y);
+        int distance = global::goal_field.distance(start);
+        if ((distance < 0) != path.empty() || (distance >= 0 && int(path.size()) - 1 < distance))
+            mismatches++;
+    }
+
+    std::cout << "Goal field check: " << n << " searches, " << mismatches << " mismatches" << std::endl;
+    return mismatches == 0;
+}
+
 template <typename State, typename Action>
 struct DefaultPolicy {
     // Action operator()(const std::shared_ptr<State>& state)
     Action operator()(const State* state)
+    {
+        return ranked(state, 1).front();
+    }
+
+    /// the `n` best of the sampled actions, best first (at least one action for n > 0, none for n == 0)
+    std::vector<Action> ranked(const State* state, size_t n)
     {
         size_t N = 100;
         double dx = state->_x - Params::goal_x();
         double dy = state->_y - Params::goal_y();
         double d = dx * dx + dy * dy;
         if (d <= Params::cell_size() * Params::cell_size()) {
-            Action best_action = state->random_action();
-            double best_value = std::numeric_limits<double>::max();
+            std::vector<std::pair<double, Action>> scored;
             for (size_t i = 0; i < N; i++) {
                 Action act = state->random_action();
                 auto final = state->move(act, true);
@@ -274,15 +395,11 @@ struct DefaultPolicy {
                 //         val -= 100;
                 //     }
                 // }
-                if (val < best_value) {
-                    best_value = val;
-                    best_action = act;
-                }
+                scored.push_back(std::make_pair(val, act));
             }
 
-            return best_action;
+            return _rank(scored, n);
         }
-        astar::AStar<> a_star;
         astar::Node ss(std::round(state->_x / Params::cell_size()), std::round(state->_y / Params::cell_size()), global::map_size_x, global::map_size_y);
         if (collides(ss._x * Params::cell_size(), ss._y * Params::cell_size()) || ss._x <= 0 || ss._x >= int(global::map_size_x) || ss._y <= 0 || ss._y >= int(global::map_size_y)) {
             astar::Node best_root = ss;
@@ -311,11 +428,10 @@ struct DefaultPolicy {
 
             ss = best_root;
         }
-        astar::Node ee(std::round(Params::goal_x() / Params::cell_size()), std::round(Params::goal_y() / Params::cell_size()), global::map_size_x, global::map_size_y);
-        auto path = a_star.search(ss, ee, astar_collides, global::map_size_x, global::map_size_y);
+        auto path = global::goal_field.path(ss, 3);
         if (path.size() < 2) {
-            // std::cout << "Error: A* path size less than 2: " << path.size() << ". Returning random action!" << std::endl;
-            return state->random_action();
+            // std::cout << "Error: path size less than 2: " << path.size() << ". Returning random action!" << std::endl;
+            return std::vector<Action>(1, state->random_action());
         }
 
         astar::Node best = path[1];
@@ -362,8 +478,7 @@ struct DefaultPolicy {
                 best_pos = new_best;
         }
 
-        Action best_action = state->random_action();
-        double best_value = std::numeric_limits<double>::max();
+        std::vector<std::pair<double, Action>> scored;
         for (size_t i = 0; i < N; i++) {
             Action act = state->random_action();
             auto final = state->move(act, true);
@@ -389,31 +504,49 @@ struct DefaultPolicy {
             //         val -= 100;
             //     }
             // }
-            if (val < best_value) {
-                best_value = val;
-                best_action = act;
-            }
+            scored.push_back(std::make_pair(val, act));
+        }
+
+        return _rank(scored, n);
+    }
+
+    // sampled actions sorted by their value (lower is better), without duplicates
+    static std::vector<Action> _rank(std::vector<std::pair<double, Action>>& scored, size_t n)
+    {
+        std::stable_sort(scored.begin(), scored.end(), [](const std::pair<double, Action>& a, const std::pair<double, Action>& b) { return a.first < b.first; });
+        std::vector<Action> ranked;
+        for (const auto& s : scored) {
+            if (ranked.size() >= n)
+                break;
+            if (std::find(ranked.begin(), ranked.end(), s.second) == ranked.end())
+                ranked.push_back(s.second);
         }
 
-        return best_action;
+        return ranked;
     }
 };
 
 template <typename Params>
 struct MobileAction {
     Eigen::VectorXd _desc;
+    // index of the behavior in the archive (-1: not in it)
+    int _index;
 
-    MobileAction() {}
-    MobileAction(const Eigen::VectorXd& desc) : _desc(desc) {}
+    MobileAction() : _index(-1) {}
+    MobileAction(const Eigen::VectorXd& desc) : _desc(desc), _index(Params::archiveparams::find(desc)) {}
+    explicit MobileAction(size_t index) : _desc(Params::archiveparams::archive[index].desc), _index(int(index)) {}
 
     MobileAction(const MobileAction& other)
     {
         _desc = other._desc;
+        _index = other._index;
     }
 
     bool operator==(const MobileAction& other) const
     {
 #ifndef TEXPLORE
+        if (_index >= 0 && other._index >= 0)
+            return _index == other._index;
         return (typename Params::archiveparams::classcompequal()(_desc, other._desc));
 #else
         return (_desc - other._desc).norm() < 1e-8;
@@ -459,27 +592,28 @@ struct MobileState {
         // #endif
     }
 
+    // ranked once per node by the tree (see mcts/candidates.hpp): the next widenings take the next ones
+    // no candidates with --candidate_actions 0: every widening calls next_action() (and the heuristic) once
+    std::vector<MobileAction<Params>> candidate_actions() const
+    {
+        if (Params::mcts_node::candidate_actions() == 0)
+            return std::vector<MobileAction<Params>>();
+        return DefaultPolicy<MobileState<Params>, MobileAction<Params>>().ranked(this, Params::mcts_node::candidate_actions());
+    }
+
     MobileAction<Params> random_action() const
     {
 #ifndef TEXPLORE
-        static tools::rgen_int_t rgen(0, Params::archiveparams::archive.size() - 1);
-        typedef typename Params::archiveparams::archive_t::const_iterator archive_it_t;
-
         MobileAction<Params> act;
         do {
-            archive_it_t it = Params::archiveparams::archive.begin();
-            std::advance(it, rgen.rand());
-            Eigen::VectorXd desc = Eigen::VectorXd::Map(it->first.data(), it->first.size());
-            act._desc = desc;
+            act = MobileAction<Params>(mcts::rng::uniform_int<size_t>(0, Params::archiveparams::archive.size() - 1));
         } while (!valid(act));
 #else
-        static tools::rgen_double_t rgen(-1.0, 1.0);
-
         MobileAction<Params> act;
         do {
-            act._desc = tools::random_vector(2).array() * 2.0 - 1.0;
+            act._desc = Eigen::VectorXd(2);
             for (int i = 0; i < act._desc.size(); i++) {
-                act._desc[i] = std::round(10.0 * act._desc[i]) / 10.0;
+                act._desc[i] = std::round(10.0 * mcts::rng::uniform(-1.0, 1.0)) / 10.0;
             }
         } while (!valid(act));
 #endif
@@ -488,10 +622,36 @@ struct MobileState {
 
     MobileState move(const MobileAction<Params>& action, bool no_noise = false) const
     {
-        double x_new, y_new, theta_new;
         Eigen::VectorXd mu;
         double sigma;
-        std::tie(mu, sigma) = global::gp_model.query(action._desc);
+        std::tie(mu, sigma) = (action._index >= 0) ? global::gp_table.query(action._index) : global::gp_model.query(action._desc);
+        return _move(mu, sigma, no_noise);
+    }
+
+    // transitions of the lockstep rollouts (see mcts::MCTSNode::compute_batched()): one GP query for all the actions
+    // outside of the archive
+    static std::vector<MobileState> move_batch(const std::vector<MobileState>& states, const std::vector<MobileAction<Params>>& actions)
+    {
+        // the behaviors of the archive are read from the posterior table, the others are queried together
+        std::vector<Eigen::VectorXd> descs;
+        for (const auto& action : actions)
+            if (action._index < 0)
+                descs.push_back(action._desc);
+        auto predictions = gp_query_batch(descs);
+
+        std::vector<MobileState> next;
+        next.reserve(states.size());
+        for (size_t i = 0, k = 0; i < states.size(); i++) {
+            auto prediction = (actions[i]._index >= 0) ? global::gp_table.query(actions[i]._index) : predictions[k++];
+            next.push_back(states[i]._move(std::get<0>(prediction), std::get<1>(prediction), false));
+        }
+        return next;
+    }
+
+    // outcome of a behavior with the GP prediction `mu` (variance `sigma`) of its displacement
+    MobileState _move(Eigen::VectorXd mu, double sigma, bool no_noise) const
+    {
+        double x_new, y_new, theta_new;
 #ifndef TEXPLORE
         if (!no_noise) {
             // std::cout << mu.transpose() << std::endl;
@@ -573,34 +733,127 @@ struct MobileState {
         double dth = std::abs(angle_dist(other._theta, _theta));
         return (std::sqrt(dx * dx + dy * dy) < Params::cell_size() && dth < 0.2);
     }
+
+    // hash of the cell of the state: cells of cell_size in position and of 2 pi / 31 (more than the 0.2 of
+    // operator==) in orientation, so that an equal state is at most one cell away in every dimension
+    size_t hash() const
+    {
+        return _hash(_cell(_x), _cell(_y), _theta_cell());
+    }
+
+    // cells that can hold a state equal to this one (the orientation wraps around)
+    std::array<size_t, 27> hash_cells() const
+    {
+        std::array<size_t, 27> cells;
+        long x = _cell(_x), y = _cell(_y), th = _theta_cell();
+        size_t k = 0;
+        for (long i = -1; i <= 1; i++)
+            for (long j = -1; j <= 1; j++)
+                for (long t = -1; t <= 1; t++)
+                    cells[k++] = _hash(x + i, y + j, (th + t + _theta_cells) % _theta_cells);
+        return cells;
+    }
+
+    static constexpr long _theta_cells = 31;
+
+    static long _cell(double v)
+    {
+        return static_cast<long>(std::floor(v / Params::cell_size()));
+    }
+
+    long _theta_cell() const
+    {
+        double th = _theta - 2 * M_PI * std::floor(_theta / (2 * M_PI));
+        return std::min<long>(static_cast<long>(th / (2 * M_PI / _theta_cells)), _theta_cells - 1);
+    }
+
+    static size_t _hash(long x, long y, long th)
+    {
+        size_t seed = 0;
+        mcts::hash_combine(seed, x);
+        mcts::hash_combine(seed, y);
+        mcts::hash_combine(seed, th);
+        return seed;
+    }
 };
 
 struct RewardFunction {
     template <typename State>
-    double operator()(std::shared_ptr<State> from_state, MobileAction<Params> action, std::shared_ptr<State> to_state)
+    double operator()(const State& from_state, const MobileAction<Params>& action, const State& to_state)
     {
         // Check if state is outside of bounds
-        if (to_state->_x < 0.0 || to_state->_x >= global::map_size_x * Params::cell_size() || to_state->_y < 0.0 || to_state->_y >= global::map_size_y * Params::cell_size())
+        if (to_state._x < 0.0 || to_state._x >= global::map_size_x * Params::cell_size() || to_state._y < 0.0 || to_state._y >= global::map_size_y * Params::cell_size())
             return -1000.0;
 
         // Return values
-        if (collides(to_state->_x, to_state->_y) || collides(Eigen::Vector2d(from_state->_x, from_state->_y), Eigen::Vector2d(to_state->_x, to_state->_y)))
+        if (collides(to_state._x, to_state._y) || collides(Eigen::Vector2d(from_state._x, from_state._y), Eigen::Vector2d(to_state._x, to_state._y)))
             return -1000.0;
 
-        if (to_state->goal())
+        if (to_state.goal())
             return 100.0;
         return 0.0;
-        // double dx = to_state->_x - Params::goal_x();
-        // double dy = to_state->_y - Params::goal_y();
+        // double dx = to_state._x - Params::goal_x();
+        // double dy = to_state._y - Params::goal_y();
         // return -(dx * dx + dy * dy);
     }
 };
 
+// early stopping of the search once the most visited action has enough of the visits (--visit_share, 0: never)
+struct StopCriterion {
+    template <typename Node>
+    bool operator()(const Node& node, size_t iterations)
+    {
+        return Params::stop::visit_share() > 0.0 && mcts::VisitShareStop<Params>()(node, iterations);
+    }
+};
+
+// serializers of the tree snapshots (see mcts/snapshot.hpp): the pose of the states, the descriptor of the actions
+struct SnapshotState {
+    template <typename State>
+    void operator()(std::string& out, const State& state) const
+    {
+        mcts::snapshot::put(out, state._x);
+        mcts::snapshot::put(out, state._y);
+        mcts::snapshot::put(out, state._theta);
+    }
+};
+
+struct SnapshotAction {
+    template <typename Action>
+    void operator()(std::string& out, const Action& action) const
+    {
+        for (int i = 0; i < action._desc.size(); i++)
+            mcts::snapshot::put(out, action._desc[i]);
+    }
+};
+
+// value of the state where a rollout is cut: the goal reward, discounted by the length of the
+// shortest path to the goal on the grid (one cell per step); 0 if the goal cannot be reached from the state's cell
+template <typename State>
+struct GoalValue {
+    double operator()(const State& state)
+    {
+        if (!Params::mcts_node::leaf_value())
+            return 0.0;
+        astar::Node ss(std::round(state._x / Params::cell_size()), std::round(state._y / Params::cell_size()), global::map_size_x, global::map_size_y);
+        if (ss._x < 0 || ss._x >= int(global::map_size_x) || ss._y < 0 || ss._y >= int(global::map_size_y) || collides(ss._x * Params::cell_size(), ss._y * Params::cell_size()))
+            return 0.0;
+        int distance = global::goal_field.distance(ss);
+        if (distance < 0)
+            return 0.0;
+        return 100.0 * std::pow(Params::mcts_node::gamma(), double(distance));
+    }
+};
+
 bool load_archive(const std::string& filename)
 {
     Params::archiveparams::archive.clear();
+    Params::archiveparams::index.clear();
     binary_map::BinaryMap b_map = binary_map::load(filename);
 
+    // same behaviors and order as the previous std::map archive (equal descriptors: the last one)
+    std::map<std::vector<double>, Params::archiveparams::elem_archive, Params::archiveparams::classcomp> loaded;
+
     for (auto v : b_map.elems) {
         std::vector<double> desc(v.pos.size(), 0.0);
         std::copy(v.pos.begin(), v.pos.end(), desc.begin());
@@ -621,22 +874,87 @@ bool load_archive(const std::string& filename)
         elem.cos_theta = std::cos(v.extra[2]);
         elem.sin_theta = std::sin(v.extra[2]);
         // std::cout << elem.x << " " << elem.y << " " << v.extra[2] << std::endl;
-        Params::archiveparams::archive[desc] = elem;
+        elem.desc = Eigen::VectorXd::Map(desc.data(), desc.size());
+        loaded[desc] = elem;
     }
 
+    std::vector<Eigen::VectorXd> descs;
+    for (const auto& it : loaded) {
+        Params::archiveparams::index[Params::archiveparams::key(it.second.desc)] = Params::archiveparams::archive.size();
+        Params::archiveparams::archive.push_back(it.second);
+        descs.push_back(it.second.desc);
+    }
+    global::gp_table.reset(global::gp_model, descs);
+
     std::cout << "Loaded " << Params::archiveparams::archive.size() << " elements!" << std::endl;
 
     return true;
 }
 
+// --check: largest difference between the posterior table and the GP queried directly, at all the behaviors of
+// the archive (relative to the magnitude of the mean)
+double gp_table_error(const GP_t& gp, const posterior::Table<GP_t>& table)
+{
+    double error = 0;
+    for (size_t i = 0; i < table.size(); i++) {
+        Eigen::VectorXd mu, mu_table;
+        double sigma, sigma_table;
+        std::tie(mu, sigma) = gp.query(Params::archiveparams::archive[i].desc);
+        std::tie(mu_table, sigma_table) = table.query(i);
+        error = std::max(error, (mu - mu_table).cwiseAbs().maxCoeff() / (1.0 + mu.cwiseAbs().maxCoeff()));
+        error = std::max(error, std::abs(sigma - sigma_table));
+    }
+    return error;
+}
+
+// add an observation of the behavior `desc` (archive index `index`, -1 if it is not in the archive) to the GP
+// and update the posterior table (rank-one update, recomputed for a behavior outside of the archive)
+void gp_add_sample(int index, const Eigen::VectorXd& desc, const Eigen::VectorXd& observation, double noise)
+{
+    if (index >= 0)
+        global::gp_table.add_sample(global::gp_model, index, observation, noise);
+    else {
+        global::gp_model.add_sample(desc, observation, noise);
+        global::gp_table.reset(global::gp_model);
+    }
+
+    if (Params::check()) {
+        double error = gp_table_error(global::gp_model, global::gp_table);
+        if (error > 1e-6) {
+            std::cerr << "Posterior table check: error " << error << " after " << global::gp_model.nb_samples() << " samples" << std::endl;
+            exit(1);
+        }
+    }
+}
+
+// --check: the posterior table against GP::query() after `n` samples at random behaviors of the archive, with
+// observations around the behaviors (on copies of the GP and of the table)
+bool check_gp_table(size_t n)
+{
+    GP_t gp = global::gp_model;
+    posterior::Table<GP_t> table = global::gp_table;
+    double error = gp_table_error(gp, table);
+    for (size_t k = 0; k < n; k++) {
+        size_t i = mcts::rng::uniform_int<size_t>(0, table.size() - 1);
+        const auto& elem = Params::archiveparams::archive[i];
+        double theta = std::atan2(elem.sin_theta, elem.cos_theta) + mcts::rng::gaussian(0.0, 0.3);
+        Eigen::VectorXd observation(4);
+        observation << elem.x + mcts::rng::gaussian(0.0, 0.1), elem.y + mcts::rng::gaussian(0.0, 0.1), std::cos(theta), std::sin(theta);
+        table.add_sample(gp, i, observation, 0.01);
+        error = std::max(error, gp_table_error(gp, table));
+    }
+
+    std::cout << "Posterior table check: " << n << " samples, max error " << error << std::endl;
+    return error <= 1e-6;
+}
+
 void execute(const Eigen::VectorXd& desc, int t, bool stat = true)
 {
-    std::vector<double> d(desc.size(), 0.0);
-    Eigen::VectorXd::Map(d.data(), d.size()) = desc;
 #ifndef TEXPLORE
-    std::vector<double> ctrl = Params::archiveparams::archive[d].controller;
+    int id = Params::archiveparams::find(desc);
+    std::vector<double> ctrl = (id >= 0) ? Params::archiveparams::archive[id].controller : std::vector<double>();
 #else
-    std::vector<double> ctrl = d;
+    std::vector<double> ctrl(desc.data(), desc.data() + desc.size());
 #endif
 
     if (stat) {
@@ -710,6 +1028,10 @@ std::tuple<bool, size_t, size_t> reach_target(const Eigen::Vector3d& goal_state,
     Params::set_goal_x(goal_state(0));
     Params::set_goal_y(goal_state(1));
     Params::set_goal_theta(goal_state(2));
+    astar::Node goal_cell(std::round(goal_state(0) / Params::cell_size()), std::round(goal_state(1) / Params::cell_size()), global::map_size_x, global::map_size_y);
+    global::goal_field.build(goal_cell, astar_collides, global::map_size_x, global::map_size_y);
+    if (Params::check() && !check_goal_field(goal_cell, 1000))
+        exit(1);
 
     global::target_num++;
 
@@ -730,6 +1052,16 @@ std::tuple<bool, size_t, size_t> reach_target(const Eigen::Vector3d& goal_state,
     bool terminal = false;
     Params::set_collisions(0);
 
+#ifdef OPEN_LOOP
+    // statistics per action sequence: one node per action instead of one per sampled outcome
+    using outcome_select = mcts::OpenLoopOutcomeSelect;
+#else
+    using outcome_select = mcts::ContinuousOutcomeSelect<Params>;
+#endif
+    using tree_type = mcts::MCTSNode<Params, MobileState<Params>, mcts::SimpleStateInit<MobileState<Params>>, mcts::SimpleValueInit, mcts::UCTValue<Params>, mcts::UniformRandomPolicy<MobileState<Params>, MobileAction<Params>>, MobileAction<Params>, mcts::SPWSelectPolicy<Params>, outcome_select, mcts::ArenaStorage, GoalValue<MobileState<Params>>>;
+    std::shared_ptr<tree_type> tree = nullptr;
+    mcts::snapshot::AsyncWriter snapshot_writer;
+
     while (!terminal && !collided && (n < max_iter)) {
         auto t1 = std::chrono::steady_clock::now();
         // Get last post from hexapod simulation/real robot
@@ -737,9 +1069,24 @@ std::tuple<bool, size_t, size_t> reach_target(const Eigen::Vector3d& goal_state,
         // DefaultPolicy<MobileState<Params>, MobileAction<Params>>()(&init, true);
 
         // Run MCTS
-        auto tree = std::make_shared<mcts::MCTSNode<Params, MobileState<Params>, mcts::SimpleStateInit<MobileState<Params>>, mcts::SimpleValueInit, mcts::UCTValue<Params>, mcts::UniformRandomPolicy<MobileState<Params>, MobileAction<Params>>, MobileAction<Params>, mcts::SPWSelectPolicy<Params>, mcts::ContinuousOutcomeSelect<Params>>>(init, 1000);
-
-        tree->compute(world, Params::iterations());
+        if (!tree || !Params::mcts_node::reuse_tree())
+            tree = std::make_shared<tree_type>(init, Params::mcts_node::rollout_depth(), Params::mcts_node::gamma());
+        // the values depend on the current model: one table per step
+        if (Params::mcts_node::transposition_table() > 0)
+            tree->set_transposition_table(std::make_shared<tree_type::table_type>(Params::mcts_node::transposition_table()));
+
+        if (Params::time_budget() > 0.0) {
+            // bounded decision latency: plan until the budget of this step is spent
+            auto deadline = t1 + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(Params::time_budget()));
+            size_t iterations = tree->compute(world, deadline, StopCriterion());
+            std::cout << "Iterations: " << iterations << std::endl;
+        }
+        else if (Params::mcts_node::parallel_tree())
+            tree->compute_tree_parallel(world, Params::iterations());
+        else if (Params::mcts_node::batch() > 0)
+            tree->compute_batched(world, Params::iterations(), Params::mcts_node::batch());
+        else
+            tree->compute(world, Params::iterations(), StopCriterion());
 
         auto time_running = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t1).count();
         // std::cout << "Time in sec: " << time_running / 1000.0 << std::endl;
@@ -765,12 +1112,26 @@ std::tuple<bool, size_t, size_t> reach_target(const Eigen::Vector3d& goal_state,
         std::cout << "avg: " << (sum / double(tree->children().size())) << std::endl;
         auto tmp = init.move(best->action(), true);
         std::cout << tmp._x << " " << tmp._y << " -> " << tmp._theta << std::endl;
-        global::iter_file << n << " " << time_running / 1000.0 << " " << best->value() / double(best->visits()) << " " << other_best->value() / double(other_best->visits()) << " " << (sum / double(tree->children().size())) << " " << tmp._x << " " << tmp._y << " " << tmp._theta << std::endl;
+        global::iter_file << n << " " << time_running / 1000.0 << " " << best->value() / double(best->visits()) << " " << other_best->value() / double(other_best->visits()) << " " << (sum / double(tree->children().size())) << " " << tmp._x << " " << tmp._y << " " << tmp._theta;
+#ifdef MCTS_STATS
+        // search profile of the step: iterations, nodes, depth, branching at the root, mean rollout length, time (in ms) of each phase
+        mcts::SearchStats stats = tree->stats();
+        global::iter_file << " " << stats.iterations << " " << stats.nodes() << " " << stats.depth_nodes.size() << " " << stats.branching(0) << " " << stats.mean_rollout_length() << " " << stats.select_ns / 1e6 << " " << stats.expand_ns / 1e6 << " " << stats.simulate_ns / 1e6 << " " << stats.backprop_ns / 1e6 << " " << stats.merge_ns / 1e6;
+#endif
+        global::iter_file << std::endl;
+        // written in the background while the action is executed and the next step planned (on a new tree, or on
+        // the copy of the kept subtree made by reroot() with ArenaStorage)
+        if (Params::mcts_node::snapshots())
+            snapshot_writer.write("tree_" + std::to_string(global::target_num) + "_" + std::to_string(n) + ".bin", tree, SnapshotState(), SnapshotAction());
 
         // Execute in simulation/real robot
         Eigen::Vector3d prev_pose = global::robot_pose;
         execute(best->action()._desc, Params::time_steps());
 
+        // Keep the explored subtree of the outcome we ended up in for the next step
+        if (Params::mcts_node::reuse_tree())
+            tree = tree->reroot(best->action(), MobileState<Params>(global::robot_pose(0), global::robot_pose(1), global::robot_pose(2)));
+
         std::cout << "Robot " << n << ": " << global::robot_pose.transpose() << std::endl;
         global::robot_file << n << " " << global::robot_pose(0) << " " << global::robot_pose(1) << " " << global::robot_pose(2) << std::endl;
 
@@ -787,7 +1148,7 @@ std::tuple<bool, size_t, size_t> reach_target(const Eigen::Vector3d& goal_state,
             // Eigen::VectorXd test;
             // test = global::gp_model.mu(best->action()._desc);
             // std::cout << test(0) << " " << test(1) << " " << test(2) << " " << test(3) << std::endl;
-            global::gp_model.add_sample(best->action()._desc, data, 0.01);
+            gp_add_sample(best->action()._index, best->action()._desc, data, 0.01);
             global::misc_file << data(0) << " " << data(1) << " " << data(2) << " " << data(3) << " ";
             // std::cout << observation(0) << " " << observation(1) << " " << std::cos(observation(2)) << " " << std::sin(observation(2)) << std::endl;
             // std::cout << observation(2) << std::endl;
@@ -915,6 +1276,10 @@ std::tuple<std::vector<Eigen::Vector3d>, Eigen::Vector3d> init_map(const std::st
     global::map_size_x = c;
     global::map_size_y = r;
 
+    global::obstacle_field.build(global::obstacles, Params::cell_size() / 4.0, Params::cell_size());
+    // the edges cached by the A* searches of a previous map are stale
+    astar::invalidate();
+
     if (!goal_in_map || !init_in_map) {
         std::cerr << "No goal or robot in the map." << std::endl;
         exit(1);
@@ -950,27 +1315,46 @@ MCTS_DECLARE_DYN_PARAM(double, Params, goal_x);
 MCTS_DECLARE_DYN_PARAM(double, Params, goal_y);
 MCTS_DECLARE_DYN_PARAM(double, Params, goal_theta);
 MCTS_DECLARE_DYN_PARAM(double, Params, iterations);
+MCTS_DECLARE_DYN_PARAM(double, Params, time_budget);
 MCTS_DECLARE_DYN_PARAM(bool, Params, learning);
 MCTS_DECLARE_DYN_PARAM(size_t, Params, collisions);
+MCTS_DECLARE_DYN_PARAM(bool, Params, check);
 MCTS_DECLARE_DYN_PARAM(size_t, Params::mcts_node, parallel_roots);
+MCTS_DECLARE_DYN_PARAM(bool, Params::mcts_node, parallel_tree);
+MCTS_DECLARE_DYN_PARAM(bool, Params::mcts_node, reuse_tree);
+MCTS_DECLARE_DYN_PARAM(size_t, Params::mcts_node, transposition_table);
+MCTS_DECLARE_DYN_PARAM(size_t, Params::mcts_node, rollout_depth);
+MCTS_DECLARE_DYN_PARAM(bool, Params::mcts_node, leaf_value);
+MCTS_DECLARE_DYN_PARAM(size_t, Params::mcts_node, candidate_actions);
+MCTS_DECLARE_DYN_PARAM(bool, Params::mcts_node, snapshots);
+MCTS_DECLARE_DYN_PARAM(size_t, Params::mcts_node, batch);
+MCTS_DECLARE_DYN_PARAM(double, Params::stop, visit_share);
+MCTS_DECLARE_DYN_PARAM(size_t, Params::stop, min_iterations);
 BO_DECLARE_DYN_PARAM(double, Params::kernel_exp, sigma_sq);
 BO_DECLARE_DYN_PARAM(double, Params::kernel_exp, l);
 
 Params::archiveparams::archive_t Params::archiveparams::archive;
+std::unordered_map<Params::archiveparams::key_t, size_t, Params::archiveparams::key_hash> Params::archiveparams::index;
 
 int main(int argc, char** argv)
 {
     mcts::par::init();
+    mcts::rng::seed(std::random_device()());
 
     std::string map_string = "";
     std::string map_file = "";
     std::string archive_file = "";
     std::vector<int> removed_legs, shortened_legs;
     bool no_learning = false;
+    bool parallel_tree = false;
+    bool reuse_tree = false;
+    bool leaf_value = false;
+    bool snapshots = false;
+    bool check = false;
 
     namespace po = boost::program_options;
     po::options_description desc("Command line arguments");
-    desc.add_options()("help,h", "Prints this help message")("archive,m", po::value<std::string>()->required(), "Archive file")("load,l", po::value<std::string>()->required(), "Load map from file")("uct,c", po::value<double>(), "UCT c value (in range (0,+00))")("spw,a", po::value<double>(), "SPW a value (in range (0,1))")("dpw,b", po::value<double>(), "DPW b value (in range (0,1))")("iter,i", po::value<size_t>(), "Number of iteartions to run MCTS")("parallel_roots,p", po::value<size_t>(), "Number of parallel trees in MCTS")("signal_variance,v", po::value<double>(), "Initial signal variance in kernel (squared)")("kernel_scale,d", po::value<double>(), "Characteristic length scale in kernel")("no_learning,n", po::bool_switch(&no_learning), "Do not learn anything");
+    desc.add_options()("help,h", "Prints this help message")("archive,m", po::value<std::string>()->required(), "Archive file")("load,l", po::value<std::string>()->required(), "Load map from file")("uct,c", po::value<double>(), "UCT c value (in range (0,+00))")("spw,a", po::value<double>(), "SPW a value (in range (0,1))")("dpw,b", po::value<double>(), "DPW b value (in range (0,1))")("iter,i", po::value<size_t>(), "Number of iteartions to run MCTS")("time_budget", po::value<double>(), "Planning time per step in seconds (overrides iter)")("parallel_roots,p", po::value<size_t>(), "Number of parallel trees in MCTS")("signal_variance,v", po::value<double>(), "Initial signal variance in kernel (squared)")("kernel_scale,d", po::value<double>(), "Characteristic length scale in kernel")("no_learning,n", po::bool_switch(&no_learning), "Do not learn anything")("parallel_tree,t", po::bool_switch(&parallel_tree), "Grow one shared tree with all threads instead of parallel roots")("reuse_tree,u", po::bool_switch(&reuse_tree), "Keep the explored subtree between consecutive steps")("transposition_table", po::value<size_t>(), "Size of the transposition table shared by the parallel trees (0: none)")("rollout_depth", po::value<size_t>(), "Maximum number of steps of the rollouts")("leaf_value", po::bool_switch(&leaf_value), "Estimate the rest of truncated rollouts with the grid distance to the goal")("visit_share", po::value<double>(), "Stop the search once the best action has this share of the visits (0: never)")("min_iterations", po::value<size_t>(), "Iterations before the search can stop early")("candidate_actions", po::value<size_t>(), "Actions ranked at once by the heuristic when a node is widened (0: one per widening)")("snapshots", po::bool_switch(&snapshots), "Write the tree of every step to tree_<target>_<step>.bin (see mcts snapshot_reader)")("batch", po::value<size_t>(), "Leaves whose rollouts run in lockstep, with one GP query per step for all of them (0: no batching)")("check", po::bool_switch(&check), "Check the distance field of the obstacles against the exact collision checks and the posterior table against the GP, at start and after every sample, and the paths to every target against A* (exit on a mismatch)");
 
     try {
         po::variables_map vm;
@@ -1037,6 +1421,48 @@ int main(int argc, char** argv)
         else {
             Params::set_iterations(1000);
         }
+        if (vm.count("time_budget")) {
+            Params::set_time_budget(vm["time_budget"].as<double>());
+        }
+        else {
+            Params::set_time_budget(0.0);
+        }
+        if (vm.count("transposition_table")) {
+            Params::mcts_node::set_transposition_table(vm["transposition_table"].as<size_t>());
+        }
+        else {
+            Params::mcts_node::set_transposition_table(0);
+        }
+        if (vm.count("rollout_depth")) {
+            Params::mcts_node::set_rollout_depth(vm["rollout_depth"].as<size_t>());
+        }
+        else {
+            Params::mcts_node::set_rollout_depth(1000);
+        }
+        if (vm.count("batch")) {
+            Params::mcts_node::set_batch(vm["batch"].as<size_t>());
+        }
+        else {
+            Params::mcts_node::set_batch(0);
+        }
+        if (vm.count("candidate_actions")) {
+            Params::mcts_node::set_candidate_actions(vm["candidate_actions"].as<size_t>());
+        }
+        else {
+            Params::mcts_node::set_candidate_actions(10);
+        }
+        if (vm.count("visit_share")) {
+            Params::stop::set_visit_share(vm["visit_share"].as<double>());
+        }
+        else {
+            Params::stop::set_visit_share(0.0);
+        }
+        if (vm.count("min_iterations")) {
+            Params::stop::set_min_iterations(vm["min_iterations"].as<size_t>());
+        }
+        else {
+            Params::stop::set_min_iterations(100);
+        }
         if (vm.count("parallel_roots")) {
             Params::mcts_node::set_parallel_roots(vm["parallel_roots"].as<size_t>());
         }
@@ -1067,6 +1493,19 @@ int main(int argc, char** argv)
         return 1;
     }
 
+#ifdef OPEN_LOOP
+    // open-loop nodes re-sample their state at every descent: threads cannot share them
+    if (parallel_tree) {
+        std::cerr << "parallel_tree is not available with open-loop search" << std::endl;
+        return 1;
+    }
+#endif
+    Params::mcts_node::set_parallel_tree(parallel_tree);
+    Params::mcts_node::set_reuse_tree(reuse_tree);
+    Params::mcts_node::set_leaf_value(leaf_value);
+    Params::mcts_node::set_snapshots(snapshots);
+    Params::set_check(check);
+
     if (no_learning) {
         Params::set_learning(false);
         // Set variance to very small value if we do not learn
@@ -1088,6 +1527,8 @@ int main(int argc, char** argv)
     Eigen::Vector3d robot_state;
     std::vector<Eigen::Vector3d> goal_states;
     std::tie(goal_states, robot_state) = init_map(map_string);
+    if (Params::check() && (!check_obstacle_field(100000) || !check_gp_table(50)))
+        return 1;
 
     std::cout << "Initializing simulation" << std::endl;
     // initilisation of the simulation and the simulated robot
@@ -1109,7 +1550,6 @@ int main(int argc, char** argv)
         std::cout << g.transpose() << std::endl;
     std::cout << "--------------------------" << std::endl;
 
-    // hexa_init();
     if (Params::learning()) {
         write_gp("gp_0.dat");
     }